@@ -22,12 +22,26 @@
  */
 
 #include "SynthModel.h"
+#include "xfmbounce.h"
+#include "xfmdiscovery.h"
+#include "xfmpatchdiff.h"
+#include "xfmrenderer.h"
+#include "xfmworkpool.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <math.h>
 #include <string.h>
+#include <memory>
+#include <string>
 
 /*
- * SERIALPORT is the serial port to access.  We assume ttyUSB1 but it
- * will need to be changed to suit your setup.
+ * The serial port is found automatically at startup by probing every USB
+ * serial port at once (see XFMDiscovery).  SERIALPORT is only used if no
+ * synth answers within DISCOVERYBUDGET milliseconds.  To pick the ports
+ * yourself, set the XFM2_PORTS environment variable to a comma separated
+ * list, e.g. XFM2_PORTS=ttyUSB1,ttyUSB3.  XFM2_PORTS=all controls every
+ * synth that answers the probe.
  *
  * PATCHFILE is a file that holds a list of patch names.  On Linux the default
  * location is /opt/xfm2/bin/patchnames.txt.  On Windows we assume the file
@@ -44,164 +58,899 @@
 #define PATCHFILE "/opt/xfm2/bin/patchnames.txt"
 #endif
 
+#define DISCOVERYBUDGET 1000
+
+// How often to check for synths being unplugged or plugged back in, in milliseconds
+#define HOTPLUGINTERVAL 1000
+
+// Default morph update rate, per second
+#define MORPHRATE 100
+
+// Build the patch name file for a device.  The first device uses PATCHFILE,
+// any others get their number added, e.g. patchnames2.txt
+static std::string patchFileForDevice(int index)
+{
+    std::string file(PATCHFILE);
+
+    if (index > 0) {
+        size_t dot=file.rfind('.');
+        std::string n=std::to_string(index+1);
+
+        if (dot == std::string::npos) {
+            file+=n;
+        } else {
+            file.insert(dot, n);
+        }
+    }
+
+    return file;
+}
+
 // Initialise the model
 SynthModel::SynthModel(QObject *parent) : QObject(parent)
 {
-    // Allow for 128 patch names
-    m_patchNames.resize(128);
-    m_patchnumber=-1;
-    m_initialised=false;
-
-    // Set up the serial port
-    m_port=new QSerialPort(this);
-    m_port->setPortName(SERIALPORT);
-    m_port->setBaudRate(500000);
-    m_port->setDataBits(QSerialPort::Data8);
-    m_port->setStopBits(QSerialPort::StopBits::OneStop);
-    m_port->setParity(QSerialPort::Parity::NoParity);
-
-    // See if we can connect and read the initial patch into memory
-    m_port->open(QIODevice::ReadWrite);
-
-    m_isconnected=m_port->isOpen();
-    if (!m_isconnected) {
-        qDebug() << "Cannot open USB0 for read/write";
-        m_patchnumber=0;
-    } else {
-        setPatchNumber(0);
+    // One device per serial port
+    QString portlist(qgetenv("XFM2_PORTS"));
+    QStringList ports;
+
+    if (portlist == "all") {
+        ports=XFMDiscovery::findDevices(DISCOVERYBUDGET);
+    } else if (!portlist.isEmpty()) {
+        ports=portlist.split(',', QString::SkipEmptyParts);
+    } else {
+        QString port=XFMDiscovery::findDevice(DISCOVERYBUDGET);
+
+        if (!port.isEmpty()) {
+            ports.append(port);
+        }
+    }
+
+    if (ports.isEmpty()) {
+        ports.append(SERIALPORT);
+    }
+
+    for (int i=0; i<ports.size(); i++) {
+        XFMDevice *d=new XFMDevice(ports[i].trimmed(), patchFileForDevice(i), this);
+
+        // See if we can connect and read the initial patch into memory
+        if (d->open()) {
+            d->loadProgram(0, 0);
+        } else {
+            d->unit(0).patchnumber=0;
+        }
+
+        connect(d->scheduler(), &XFMParameterScheduler::drained, this, &SynthModel::schedulerDrained);
+        connect(d->automation(), &QThread::finished, this, &SynthModel::automationFinished);
+        connect(d->sequencer(), &QThread::finished, this, &SynthModel::sequencerChanged);
+        connect(d->macros(), &XFMMacros::moved, this, &SynthModel::macrosMoved);
+        d->scheduler()->setTickInterval(1000/MORPHRATE);
+        m_devices.append(d);
+    }
+
+    m_device=m_devices[0];
+    m_deviceIndex=0;
+    m_xfm2=m_device->unit(0).buffer;
+
+    m_morphPosition=0;
+    m_morphRate=MORPHRATE;
+    m_morphPending=false;
+    m_measuring=false;
+    m_backingUp=false;
+    memset(m_morphImage, 0, sizeof(m_morphImage));
+
+    // Loading a patch or switching unit changes which history and comparison applies
+    connect(this, &SynthModel::patchNumberChanged, this, &SynthModel::historyChanged);
+    connect(this, &SynthModel::unitChanged, this, &SynthModel::historyChanged);
+    connect(this, &SynthModel::patchNumberChanged, this, &SynthModel::compareChanged);
+    connect(this, &SynthModel::unitChanged, this, &SynthModel::compareChanged);
+
+    // The sequencer can follow the arpeggiator's tempo
+    connect(this, &SynthModel::arpeggiatorTempoChanged, this, &SynthModel::syncSequencerTempo);
+    connect(this, &SynthModel::patchNumberChanged, this, &SynthModel::syncSequencerTempo);
+
+    m_hotplugTimer=new QTimer(this);
+    connect(m_hotplugTimer, &QTimer::timeout, this, &SynthModel::checkConnections);
+    m_hotplugTimer->start(HOTPLUGINTERVAL);
+}
+
+// Notice synths coming and going.  A synth that comes back has already been
+// brought up to date by its device, so the pages only need refreshing
+void SynthModel::checkConnections()
+{
+    bool changed=false;
+
+    for (int i=0; i<m_devices.size(); i++) {
+        if (m_devices[i]->checkConnection()) {
+            changed=true;
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    emit connectionChanged();
+
+    if (m_device->isConnected()) {
+        emit patchNumberChanged();
+        emit patchNameChanged();
+    }
+}
+
+// Returns true if we're connected
+bool SynthModel::isConnected() const
+{
+    return m_device->isConnected();
+}
+
+// Transport counters for the current device, so the QML side (or a debugger)
+// can check how many frames were coalesced into each write
+QVariantMap SynthModel::transportStats()
+{
+    XFMTransportStats s=m_device->transport()->stats();
+    QVariantMap map;
+
+    map["frames"]=static_cast<qulonglong>(s.frames);
+    map["flushes"]=static_cast<qulonglong>(s.flushes);
+    map["bytes"]=static_cast<qulonglong>(s.bytes);
+    map["allocations"]=static_cast<qulonglong>(s.allocations);
+
+    return map;
+}
+
+// Get the synth being edited
+int SynthModel::device() const
+{
+    return m_deviceIndex;
+}
+
+// Switch to another synth.  Each device keeps its own edit buffers and
+// connection, so switching doesn't touch the serial ports at all
+void SynthModel::setDevice(int d)
+{
+    if (d < 0 || d >= m_devices.size() || d == m_deviceIndex) {
+        return;
+    }
+
+    m_deviceIndex=d;
+    m_device=m_devices[d];
+    m_xfm2=m_device->unit(m_device->activeUnit()).buffer;
+
+    emit deviceChanged();
+    emit unitChanged();
+    emit patchNumberChanged();
+}
+
+int SynthModel::deviceCount() const
+{
+    return m_devices.size();
+}
+
+QStringList SynthModel::devicePorts() const
+{
+    QStringList ports;
+
+    for (int i=0; i<m_devices.size(); i++) {
+        ports.append(m_devices[i]->portName());
+    }
+
+    return ports;
+}
+
+// Back up the stored programs of every synth to directory/bankN.bin.
+// The dumps all run at once, each on its own device's transport thread,
+// and a thread of our own waits for them so the GUI isn't held up.  The
+// devices are only touched again back on the GUI thread, once it's done
+bool SynthModel::backupBanks(const QString &directory)
+{
+    if (m_backingUp) {
+        return false;
+    }
+
+    QList<XFMDevice *> devices=m_devices;
+    std::shared_ptr<std::vector<bool>> dumped=std::make_shared<std::vector<bool>>(devices.size(), false);
+
+    for (int i=0; i<devices.size(); i++) {
+        devices[i]->startBankBackup();
+    }
+
+    QThread *thread=QThread::create([devices, dumped]() {
+        for (int i=0; i<devices.size(); i++) {
+            (*dumped)[static_cast<size_t>(i)]=devices[i]->waitForBankBackup();
+        }
+    });
+
+    connect(thread, &QThread::finished, this, [this, devices, dumped, directory]() {
+        bool ok=true;
+
+        for (int i=0; i<devices.size(); i++) {
+            std::string file=directory.toStdString()+"/bank"+std::to_string(i+1)+".bin";
+
+            if (!devices[i]->finishBankBackup((*dumped)[static_cast<size_t>(i)], file)) {
+                ok=false;
+            }
+        }
+
+        m_backingUp=false;
+        emit banksBackedUp(directory, ok);
+    });
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    m_backingUp=true;
+    thread->start();
+
+    return true;
+}
+
+// Get the unit being edited
+int SynthModel::unit() const
+{
+    return m_device->activeUnit();
+}
+
+// Switch the unit being edited.  The unit's edit buffer is only read from the
+// synth the first time, after that switching is instant
+void SynthModel::setUnit(int u)
+{
+    if (u < 0 || u >= XFM2_UNITS || u == m_device->activeUnit()) {
+        return;
+    }
+
+    XFMUnit &unit=m_device->unit(u);
+
+    m_device->setActiveUnit(u);
+    m_xfm2=unit.buffer;
+
+    if (!unit.initialised) {
+        if (unit.patchnumber < 0) {
+            unit.patchnumber=0;
+            unit.patchName=m_device->patchName(0);
+        }
+        m_device->readUnitBuffer(u);
+    }
+
+    emit unitChanged();
+    emit patchNumberChanged();
+}
+
+// Read a parameter from any unit's edit buffer
+int SynthModel::unitParameter(int unit, int offset)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return 0;
+    }
+
+    return static_cast<int>(m_device->readLocation(unit, offset));
+}
+
+// Write a parameter to any unit without making it the active unit
+bool SynthModel::setUnitParameter(int unit, int offset, int value)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return false;
+    }
+
+    bool ok=m_device->writeLocation(unit, offset, static_cast<unsigned char>(value));
+
+    if (unit == m_device->activeUnit()) {
+        emit operatorHasChanged();
+    }
+
+    return ok;
+}
+
+int SynthModel::unitPatchNumber(int unit)
+{
+    if (unit < 0 || unit >= XFM2_UNITS) {
+        return -1;
+    }
+
+    return m_device->unit(unit).patchnumber;
+}
+
+// Load a program into any unit
+bool SynthModel::setUnitPatchNumber(int unit, int p)
+{
+    if (unit < 0 || unit >= XFM2_UNITS) {
+        return false;
+    }
+
+    if (unit == m_device->activeUnit()) {
+        setPatchNumber(p);
+        return true;
+    }
+
+    if (p < 0) p=0;
+    if (p > 127) p=127;
+
+    return m_device->loadProgram(unit, p);
+}
+
+// Initialize the patch buffer by calling the init synth API
+// and then read synth parameters back into memory
+bool SynthModel::initPatchBuffer()
+{
+    if (!m_device->initUnit(m_device->activeUnit())) {
+        return false;
+    }
+
+    emit patchNumberChanged();
+
+    return true;
+}
+
+// Read the synth parameters.  Modulated values and glides give way first,
+// so what comes back is the edit buffer rather than where they'd got to
+bool SynthModel::readPatchBuffer()
+{
+    m_device->scheduler()->settle(m_device->activeUnit());
+    return m_device->readUnitBuffer(m_device->activeUnit());
+}
+
+// Get the current patch number
+int SynthModel::patchNumber() const
+{
+    return m_device->unit(m_device->activeUnit()).patchnumber;
+}
+
+// Set the current patch number and read it into memory
+void SynthModel::setPatchNumber(int p)
+{
+    if (p != patchNumber()) {
+        if (p < 0) p=0;
+        if (p > 127) p=127;
+
+        m_device->loadProgram(m_device->activeUnit(), p);
+
+        emit patchNumberChanged();
+    }
+}
+
+// Reload the current patch
+bool SynthModel::reloadPatch()
+{
+    m_device->loadProgram(m_device->activeUnit(), patchNumber());
+
+    emit patchNumberChanged();
+    return true;
+}
+
+// Load a whole patch image into the edit buffer
+bool SynthModel::loadPatchImage(const QByteArray &image)
+{
+    if (image.size() != 512) {
+        return false;
+    }
+
+    m_device->loadPatchImage(m_device->activeUnit(), reinterpret_cast<const unsigned char *>(image.constData()));
+
+    emit patchNumberChanged();
+    return true;
+}
+
+// Step back through the edits.  The pages are refreshed the same way as
+// when a patch is loaded
+bool SynthModel::undo()
+{
+    if (!m_device->undo(m_device->activeUnit())) {
+        return false;
+    }
+
+    emit patchNumberChanged();
+    return true;
+}
+
+bool SynthModel::redo()
+{
+    if (!m_device->redo(m_device->activeUnit())) {
+        return false;
+    }
+
+    emit patchNumberChanged();
+    return true;
+}
+
+bool SynthModel::canUndo() const
+{
+    return m_device->canUndo(m_device->activeUnit());
+}
+
+bool SynthModel::canRedo() const
+{
+    return m_device->canRedo(m_device->activeUnit());
+}
+
+bool SynthModel::compareWith(int p/*=-1*/)
+{
+    if (!m_device->startCompare(m_device->activeUnit(), p)) {
+        return false;
+    }
+
+    emit compareChanged();
+    return true;
+}
+
+bool SynthModel::toggleCompare()
+{
+    if (!m_device->toggleCompare(m_device->activeUnit())) {
+        return false;
+    }
+
+    emit patchNumberChanged();
+    return true;
+}
+
+void SynthModel::endCompare(bool keepB/*=false*/)
+{
+    bool wasB=comparingB();
+
+    m_device->endCompare(m_device->activeUnit(), keepB);
+
+    emit compareChanged();
+    if (wasB != keepB) {
+        emit patchNumberChanged();
+    }
+}
+
+bool SynthModel::comparing() const
+{
+    return m_device->unit(m_device->activeUnit()).comparing;
+}
+
+bool SynthModel::comparingB() const
+{
+    return m_device->unit(m_device->activeUnit()).showingB;
+}
+
+void SynthModel::morphClear()
+{
+    m_morph.clear();
+    m_morphPosition=0;
+
+    emit morphSourcesChanged();
+    emit morphPositionChanged();
+}
+
+bool SynthModel::morphAddPatch(int p)
+{
+    unsigned char image[512];
+
+    if (!m_device->readProgramImage(m_device->activeUnit(), p, image)) {
+        return false;
+    }
+
+    if (m_morph.sourceCount() == 0) {
+        memcpy(m_morphImage, m_xfm2, 512);
+    }
+
+    m_morph.addSource(image);
+    emit morphSourcesChanged();
+    return true;
+}
+
+bool SynthModel::morphAddCurrent()
+{
+    if (m_morph.sourceCount() == 0) {
+        memcpy(m_morphImage, m_xfm2, 512);
+    }
+
+    m_morph.addSource(m_xfm2);
+    emit morphSourcesChanged();
+    return true;
+}
+
+double SynthModel::morphPosition() const
+{
+    return m_morphPosition;
+}
+
+void SynthModel::setMorphPosition(double position)
+{
+    if (m_morph.sourceCount() < 2) {
+        return;
+    }
+
+    if (position < 0) position=0;
+    if (position > m_morph.sourceCount()-1) position=m_morph.sourceCount()-1;
+
+    unsigned char image[512];
+
+    m_morph.render(position, image);
+    sendMorph(image);
+
+    m_morphPosition=position;
+    emit morphPositionChanged();
+}
+
+bool SynthModel::setMorphWeights(const QVariantList &weights)
+{
+    if (m_morph.sourceCount() < 2 || weights.size() != m_morph.sourceCount()) {
+        return false;
+    }
+
+    std::vector<double> w(weights.size());
+    unsigned char image[512];
+
+    for (int i=0; i<weights.size(); i++) {
+        w[i]=weights[i].toDouble();
+        if (!(w[i] >= 0)) {
+            return false;
+        }
+    }
+
+    m_morph.renderWeighted(&w[0], image);
+    sendMorph(image);
+    return true;
+}
+
+// Hand the scheduler whatever changed since the last morph result.  It
+// keeps only the newest value for each parameter, so a fast sweep never
+// queues up more than the link can take
+void SynthModel::sendMorph(const unsigned char *image)
+{
+    unsigned short offsets[XFMPatchDiff::PatchSize];
+    int n=XFMPatchDiff::diff(m_morphImage, image, offsets);
+    int u=m_device->activeUnit();
+
+    for (int i=0; i<n; i++) {
+        m_device->scheduler()->set(u, offsets[i], image[offsets[i]]);
+    }
+
+    memcpy(m_morphImage, image, 512);
+    if (n > 0) {
+        m_morphPending=true;
+    }
+}
+
+// Once a morph has been sent the pages are refreshed to show where it ended up
+void SynthModel::schedulerDrained()
+{
+    if (m_morphPending) {
+        m_morphPending=false;
+        emit patchNumberChanged();
+    }
+}
+
+int SynthModel::morphSources() const
+{
+    return m_morph.sourceCount();
+}
+
+int SynthModel::morphRate() const
+{
+    return m_morphRate;
+}
+
+void SynthModel::setMorphRate(int rate)
+{
+    if (rate < 1) rate=1;
+    if (rate > 1000) rate=1000;
+
+    if (rate != m_morphRate) {
+        m_morphRate=rate;
+        for (int i=0; i<m_devices.size(); i++) {
+            m_devices[i]->scheduler()->setTickInterval(1000/rate);
+        }
+        emit morphRateChanged();
     }
+}
 
-    loadPatchNames();
+void SynthModel::recordAutomation()
+{
+    m_device->automation()->startRecording();
+    emit automationChanged();
 }
 
-// Returns true if we're connected
-bool SynthModel::isConnected() const
+bool SynthModel::playAutomation(bool loop/*=false*/)
 {
-    return m_isconnected;
+    bool ok=m_device->automation()->play(loop);
+
+    emit automationChanged();
+    return ok;
 }
 
-// Initialize the patch buffer by calling the init synth API
-// and then read synth parameters back into memory
-bool SynthModel::initPatchBuffer()
+void SynthModel::stopAutomation()
 {
-    if (!m_isconnected) {
-        return false;
+    m_device->automation()->stopRecording();
+    m_device->automation()->stop();
+    emit automationChanged();
+}
+
+void SynthModel::clearAutomation()
+{
+    m_device->automation()->clear();
+    emit automationChanged();
+}
+
+QVariantMap SynthModel::automationStats()
+{
+    XFMAutomationStats s=m_device->automation()->stats();
+    QVariantMap map;
+
+    map["events"]=static_cast<qulonglong>(s.events);
+    map["maxLate"]=static_cast<double>(s.maxLateNs)/1000.0;
+    map["meanLate"]=static_cast<double>(s.meanLateNs)/1000.0;
+
+    return map;
+}
+
+// Playback has finished and its values are in the edit buffer, so refresh the pages
+void SynthModel::automationFinished()
+{
+    emit automationChanged();
+    emit patchNumberChanged();
+}
+
+bool SynthModel::automationRecording() const
+{
+    return m_device->automation()->isRecording();
+}
+
+bool SynthModel::automationPlaying() const
+{
+    return m_device->automation()->isPlaying();
+}
+
+int SynthModel::automationEvents() const
+{
+    return m_device->automation()->eventCount();
+}
+
+int SynthModel::addModulator(int offset, const QString &shape, double rate, int depth)
+{
+    static const char *shapes[]={ "sine", "triangle", "saw", "square", "random", "envelope", "steps" };
+
+    for (int i=0; i<7; i++) {
+        if (shape == shapes[i]) {
+            return m_device->modulation()->add(m_device->activeUnit(), offset, static_cast<XFMModulator::Shape>(i), rate, depth);
+        }
     }
 
-    char bf[5];
+    return -1;
+}
 
-    bf[0]='i';
+bool SynthModel::removeModulator(int id)
+{
+    return m_device->modulation()->remove(id);
+}
 
-    m_port->clear();
-    m_port->write(bf, 1);
-    m_port->flush();
+void SynthModel::clearModulators()
+{
+    m_device->modulation()->clear();
+}
 
-    m_port->waitForReadyRead();
-    m_port->read(&bf[0], 1);
+// Steps run from -1 to 1
+bool SynthModel::setModulatorSteps(int id, const QVariantList &steps)
+{
+    XFMModulator *m=m_device->modulation()->find(id);
 
-    readPatchBuffer();
+    if (m == nullptr) {
+        return false;
+    }
 
-    m_patchNameBuffer="Untitled";
-    emit patchNumberChanged();
+    m->steps.resize(steps.size());
+    for (int i=0; i<steps.size(); i++) {
+        m->steps[i]=steps[i].toDouble();
+    }
 
     return true;
 }
 
-// Read the synth parameters
-bool SynthModel::readPatchBuffer()
+bool SynthModel::setModulatorEnvelope(int id, int attackms, int decayms)
 {
-    if (!m_isconnected) {
+    XFMModulator *m=m_device->modulation()->find(id);
+
+    if (m == nullptr) {
         return false;
     }
 
-    if (!m_port->isOpen()) {
-        m_initialised=true;
-        return false;
+    m->attack=attackms/1000.0;
+    m->decay=decayms/1000.0;
+    return true;
+}
+
+void SynthModel::triggerModulators()
+{
+    m_device->modulation()->trigger();
+}
+
+int SynthModel::modulationRate() const
+{
+    return m_device->modulation()->rate();
+}
+
+void SynthModel::setModulationRate(int hz)
+{
+    for (int i=0; i<m_devices.size(); i++) {
+        m_devices[i]->modulation()->setRate(hz);
     }
 
-    m_port->clear();
-    m_port->write("d", 1);
-    m_port->flush();
+    emit modulationRateChanged();
+}
+
+int SynthModel::sequencerAddTrack(int offset)
+{
+    return m_device->sequencer()->addTrack(m_device->activeUnit(), offset);
+}
+
+bool SynthModel::sequencerSetLock(int step, int track, int value)
+{
+    return m_device->sequencer()->setLock(step, track, value);
+}
 
-    qint64 bytesread=0;
+void SynthModel::sequencerClear()
+{
+    m_device->sequencer()->clear();
+    emit sequencerChanged();
+}
 
-    while (bytesread < 512) {
-        m_port->waitForReadyRead();
+bool SynthModel::startSequencer()
+{
+    bool ok=m_device->sequencer()->play();
 
-        qint64 avail=m_port->bytesAvailable();
+    emit sequencerChanged();
+    return ok;
+}
 
-        if (bytesread+avail > 512) {
-            avail=512-bytesread;
-        }
+void SynthModel::stopSequencer()
+{
+    m_device->sequencer()->stop();
+    emit sequencerChanged();
+}
+
+QVariantMap SynthModel::sequencerStats()
+{
+    XFMSequencerStats s=m_device->sequencer()->stats();
+    QVariantMap map;
+
+    map["steps"]=static_cast<qulonglong>(s.steps);
+    map["maxLate"]=static_cast<double>(s.maxLateNs)/1000.0;
+    map["meanLate"]=static_cast<double>(s.meanLateNs)/1000.0;
+    map["maxJitter"]=static_cast<double>(s.maxJitterNs)/1000.0;
+
+    return map;
+}
+
+int SynthModel::addMacro()
+{
+    return m_device->macros()->add(m_device->activeUnit());
+}
+
+bool SynthModel::removeMacro(int id)
+{
+    return m_device->macros()->remove(id);
+}
+
+void SynthModel::clearMacros()
+{
+    m_device->macros()->clear();
+}
+
+bool SynthModel::addMacroTarget(int id, int offset, int from, int to, const QString &curve)
+{
+    static const char *curves[]={ "linear", "exponential", "logarithmic", "scurve" };
 
-        m_port->read(reinterpret_cast<char *>(&m_xfm2[bytesread]), avail);
-        bytesread+=avail;
+    for (int i=0; i<4; i++) {
+        if (curve == curves[i]) {
+            return m_device->macros()->addTarget(id, offset, from, to, static_cast<XFMCurve::Shape>(i));
+        }
     }
 
-    qDebug() << "read patch buffer (" << m_patchnumber<< ")";
-    m_initialised=true;
-    return true;
+    return false;
 }
 
-// Get the current patch number
-int SynthModel::patchNumber() const
+bool SynthModel::clearMacroTargets(int id)
 {
-    return m_patchnumber;
+    return m_device->macros()->clearTargets(id);
 }
 
-// Set the current patch number and read it into memory
-void SynthModel::setPatchNumber(int p)
+bool SynthModel::setMacro(int id, int value)
 {
-    if (p != m_patchnumber) {
-        if (p < 0) p=0;
-        if (p > 127) p=127;
+    return m_device->macros()->set(id, value);
+}
+
+int SynthModel::macroValue(int id)
+{
+    XFMMacro *m=m_device->macros()->find(id);
 
-        m_patchnumber=p;
-        m_patchNameBuffer=m_patchNames[m_patchnumber];
+    return m == nullptr ? -1 : m->value;
+}
 
-        if (m_isconnected) {
-            char bf[5];
+bool SynthModel::bindMacroControlChange(int id, int cc)
+{
+    return m_device->macros()->bindControlChange(id, cc);
+}
 
-            bf[0]='r';
-            bf[1]=static_cast<char>(p);
+bool SynthModel::bindMacroPerformanceControl(int id, int control)
+{
+    return m_device->macros()->bindPerformanceControl(id, control-1);
+}
 
-            m_port->clear();
-            m_port->write(bf, 2);
-            m_port->flush();
+// CCs go to the macros of whichever device is selected
+int SynthModel::midiControlChange(int cc, int value)
+{
+    return m_device->macros()->controlChange(cc, value);
+}
 
-            m_port->waitForReadyRead();
-            m_port->read(&bf[0], 1);
+// Slews apply to every synth, so a sweep feels the same whichever is selected
+void SynthModel::setParameterSlew(int offset, int ms, const QString &curve/*="linear"*/)
+{
+    static const char *curves[]={ "linear", "exponential", "logarithmic", "scurve" };
+    XFMCurve::Shape shape=XFMCurve::Linear;
 
-            readPatchBuffer();
+    for (int i=0; i<4; i++) {
+        if (curve == curves[i]) {
+            shape=static_cast<XFMCurve::Shape>(i);
         }
+    }
+
+    for (int i=0; i<m_devices.size(); i++) {
+        m_devices[i]->scheduler()->setSlew(offset, ms, shape);
+    }
+}
+
+int SynthModel::parameterSlew(int offset)
+{
+    return m_device->scheduler()->slew(offset);
+}
+
+void SynthModel::clearParameterSlews()
+{
+    for (int i=0; i<m_devices.size(); i++) {
+        m_devices[i]->scheduler()->clearSlews();
+    }
+}
 
+// A macro edited the patch, so refresh the pages if it's the one on screen
+void SynthModel::macrosMoved(int u)
+{
+    if (sender() == m_device->macros() && u == m_device->activeUnit()) {
+        emit historyChanged();
         emit patchNumberChanged();
     }
 }
 
-// Reload the current patch
-bool SynthModel::reloadPatch()
+int SynthModel::sequencerLength() const
 {
-    m_patchNameBuffer=m_patchNames[m_patchnumber];
+    return m_device->sequencer()->length();
+}
 
-    if (m_isconnected) {
-        char bf[5];
+void SynthModel::setSequencerLength(int steps)
+{
+    m_device->sequencer()->setLength(steps);
+    emit sequencerChanged();
+}
 
-        bf[0]='r';
-        bf[1]=static_cast<char>(m_patchnumber);
+double SynthModel::sequencerTempo() const
+{
+    return m_device->sequencer()->tempo();
+}
 
-        m_port->clear();
-        m_port->write(bf, 2);
-        m_port->flush();
+void SynthModel::setSequencerTempo(double bpm)
+{
+    m_device->sequencer()->setTempo(bpm);
+    emit sequencerChanged();
+}
 
-        m_port->waitForReadyRead();
-        m_port->read(&bf[0], 1);
+bool SynthModel::sequencerTempoLock() const
+{
+    return m_device->sequencer()->tempoLock();
+}
 
-        readPatchBuffer();
-    }
+void SynthModel::setSequencerTempoLock(bool locked)
+{
+    m_device->sequencer()->setTempoLock(locked);
+    emit sequencerChanged();
+}
 
-    emit patchNumberChanged();
-    return true;
+bool SynthModel::sequencerPlaying() const
+{
+    return m_device->sequencer()->isPlaying();
+}
+
+void SynthModel::syncSequencerTempo()
+{
+    m_device->sequencer()->syncTempo();
 }
 
 // Write the current patch buffer.  This
@@ -210,36 +959,11 @@ bool SynthModel::reloadPatch()
 // with the buffer we have in memory
 bool SynthModel::writePatchBuffer(int toPatch/*=-1*/)
 {
-    if (toPatch >= 0) {
-        if (toPatch > 127) {
-            return false;
-        }
-
-        m_patchnumber=toPatch;
-    }
-
-    if (!m_isconnected) {
-        if (toPatch >= 0) {
-            emit patchNumberChanged();
-        }
-        return true;
+    if (toPatch > 127) {
+        return false;
     }
 
-    char bf[5];
-
-    bf[0]='w';
-    bf[1]=static_cast<char>(m_patchnumber);
-    m_port->clear();
-    m_port->write(bf, 2);
-    m_port->waitForBytesWritten();
-
-    m_port->waitForReadyRead();
-    m_port->read(&bf[0], 1);
-
-    m_patchNames[m_patchnumber]=m_patchNameBuffer;
-    savePatchNames();
-
-    readPatchBuffer();
+    m_device->writeProgram(m_device->activeUnit(), toPatch >= 0 ? toPatch : patchNumber());
 
     if (toPatch >= 0) {
         emit patchNumberChanged();
@@ -255,65 +979,162 @@ bool SynthModel::writePatchBuffer(int toPatch/*=-1*/)
 // the hardware.
 unsigned char SynthModel::readMemoryLocation(XFM2Parameter offset, bool useCache/*=true*/)
 {
-    if ((!useCache || !m_initialised) && m_isconnected) {
-        unsigned char bf[5];
+    return m_device->readLocation(m_device->activeUnit(), offset, useCache);
+}
 
-        m_port->clear();
+// Write a single parameter.
+// The model implements a write-through cache.  Parameters are always written
+// directly to the synth but also copied into our memory buffer.
+// However a parameter is only written if it is different to the copy in memory, for faster performance.
+// The frame is encoded into the transport's ring, so this never allocates.
+bool SynthModel::writeMemoryLocation(XFM2Parameter offset, unsigned char data)
+{
+    bool couldUndo=canUndo();
+    bool couldRedo=canRedo();
+    bool ok=m_device->writeLocation(m_device->activeUnit(), offset, data);
 
-        bf[0]='g';
-        if (offset < 256) {
-            bf[1]=static_cast<unsigned char>(offset);
-            m_port->write(reinterpret_cast<char *>(bf), 2);
-            m_port->waitForBytesWritten();
-        } else {
-            bf[1]=0xff;
-            bf[2]=static_cast<unsigned char>(offset-256);
-            m_port->write(reinterpret_cast<char *>(bf), 3);
-            m_port->waitForBytesWritten();
+    if (couldUndo != canUndo() || couldRedo != canRedo()) {
+        emit historyChanged();
+    }
+
+    return ok;
+}
+
+int SynthModel::parameterValue(int offset)
+{
+    if (offset < 0 || offset > 511) {
+        return 0;
+    }
+
+    return readMemoryLocation(static_cast<XFM2Parameter>(offset));
+}
+
+// Holding the transport keeps both frames (and the unit select) in one write
+bool SynthModel::writeParameterPair(int xoffset, int xvalue, int yoffset, int yvalue)
+{
+    const int offsets[2]={ xoffset, yoffset };
+    const int values[2]={ xvalue, yvalue };
+    XFMTransport *transport=m_device->transport();
+    bool ok=true;
+
+    transport->hold();
+
+    for (int i=0; i<2; i++) {
+        if (offsets[i] < 0 || offsets[i] > 511) {
+            continue;
         }
 
-        m_port->waitForReadyRead();
-        m_port->read(reinterpret_cast<char *>(&bf[0]), 1);
-        m_xfm2[offset]=bf[0];
+        int v=values[i];
+        if (v < 0) v=0;
+        if (v > 255) v=255;
+
+        if (!writeMemoryLocation(static_cast<XFM2Parameter>(offsets[i]), static_cast<unsigned char>(v))) {
+            ok=false;
+        }
     }
 
-    return m_xfm2[offset];
+    transport->release();
+    return ok;
 }
 
-// Write a single parameter.
-// The model implements a write-through cache.  Parameters are always written
-// directly to the synth but also copied into our memory buffer.
-// However a parameter is only written if it is different to the copy in memory, for faster performance.
-bool SynthModel::writeMemoryLocation(XFM2Parameter offset, unsigned char data)
+void SynthModel::refreshPages()
 {
-    if (data == m_xfm2[offset]) {
-        return true;
+    emit patchNumberChanged();
+}
+
+QVariantMap SynthModel::analysePatch(int note/*=60*/, int velocity/*=100*/, bool fixedPoint/*=false*/)
+{
+    XFMRenderer renderer;
+    std::vector<float> out;
+    QElapsedTimer timer;
+    double peak=0;
+    double sum=0;
+
+    timer.start();
+    renderer.setMode(fixedPoint ? XFMRenderer::Fixed : XFMRenderer::Float);
+    renderer.loadPatch(m_xfm2);
+    renderer.renderNote(note, velocity, 1.0, 4.0, out);
+
+    for (size_t i=0; i<out.size(); i++) {
+        double v=fabs(out[i]);
+
+        peak=v > peak ? v : peak;
+        sum+=v*v;
     }
 
-    m_xfm2[offset]=data;
+    QVariantMap map;
 
-    if (!m_isconnected || !m_initialised) {
-        return true;
+    map["peak"]=peak;
+    map["rms"]=out.empty() ? 0.0 : sqrt(sum/out.size());
+    map["seconds"]=out.size()/2/static_cast<double>(renderer.sampleRate());
+    map["renderMs"]=static_cast<double>(timer.nsecsElapsed())/1000000.0;
+
+    return map;
+}
+
+/*
+ * Measuring takes a few seconds, so it's done on a thread of its own with
+ * a copy of the edit buffer.  Every worker is given plenty of voices, so
+ * none of them runs dry
+ */
+bool SynthModel::renderThroughput(double seconds/*=1*/)
+{
+    // Two at once would only be measuring each other
+    if (m_measuring) {
+        return false;
     }
 
-    unsigned char bf[5];
+    std::vector<unsigned char> patch(m_xfm2, m_xfm2+512);
+    std::shared_ptr<QVariantMap> map=std::make_shared<QVariantMap>();
 
-    m_port->clear();
+    QThread *thread=QThread::create([patch, seconds, map]() {
+        XFMWorkPool &pool=XFMWorkPool::shared();
+        XFMRenderer renderer(48000, pool.workers()*XFMRenderer::DefaultVoices);
 
-    bf[0]='s';
-    if (offset < 256) {
-        bf[1]=static_cast<unsigned char>(offset);
-        bf[2]=data;
-        m_port->write(reinterpret_cast<char *>(bf), 3);
-        m_port->waitForBytesWritten();
-    } else {
-        bf[1]=0xff;
-        bf[2]=static_cast<unsigned char>(offset-256);
-        bf[3]=data;
-        m_port->write(reinterpret_cast<char *>(bf), 4);
-        m_port->waitForBytesWritten();
+        renderer.loadPatch(&patch[0]);
+        (*map)["cores"]=pool.workers();
+        (*map)["voicesPerCore"]=renderer.voicesPerCore(seconds);
+
+        renderer.setPool(&pool);
+        (*map)["voices"]=renderer.voicesInRealTime(seconds);
+    });
+
+    connect(thread, &QThread::finished, this, [this, map]() {
+        m_measuring=false;
+    m_backingUp=false;
+        emit throughputMeasured(*map);
+    });
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    m_measuring=true;
+    thread->start();
+
+    return true;
+}
+
+bool SynthModel::bounceMidi(const QString &midiFile, const QString &wavFile)
+{
+    std::shared_ptr<XFMMidiFile> midi=std::make_shared<XFMMidiFile>();
+
+    if (!midi->load(midiFile.toStdString())) {
+        qDebug() << "Couldn't read" << midiFile;
+        return false;
     }
 
+    std::vector<unsigned char> patch(m_xfm2, m_xfm2+512);
+    std::string filename=wavFile.toStdString();
+    std::shared_ptr<bool> ok=std::make_shared<bool>(false);
+
+    QThread *thread=QThread::create([midi, patch, filename, ok]() {
+        *ok=XFMBounce(*midi).render(&patch[0], filename);
+    });
+
+    connect(thread, &QThread::finished, this, [this, wavFile, ok]() {
+        emit bounceFinished(wavFile, *ok);
+    });
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start(QThread::LowPriority);
+
     return true;
 }
 
@@ -1819,9 +2640,11 @@ bool SynthModel::makeDX7Algorithm(int a)
 
     int offset=a*7;
 
+    m_device->transport()->hold();
     for (int i=0; i<6; i++) {
         writeMemoryLocation(static_cast<XFM2Parameter>(ALGO1+i), dx7[offset+i]);
     }
+    m_device->transport()->release();
 
     emit operatorHasChanged();
     return true;
@@ -2082,6 +2905,9 @@ QList<QObject *> SynthModel::fmOperators()
 
 bool SynthModel::updateOperator(XFMOperator *op, bool notify/*=false*/)
 {
+    // Send all of the operator's changes to the synth in one write
+    m_device->transport()->hold();
+
     switch (op->operatorNumber()) {
         case 0:
             writeMemoryLocation(ALGO1, static_cast<unsigned char>(op->algorithm()));
@@ -2309,6 +3135,8 @@ bool SynthModel::updateOperator(XFMOperator *op, bool notify/*=false*/)
             break;
     }
 
+    m_device->transport()->release();
+
     if (notify) {
         emit operatorHasChanged();
     }
@@ -2316,85 +3144,13 @@ bool SynthModel::updateOperator(XFMOperator *op, bool notify/*=false*/)
     return true;
 }
 
-/*
- * Patch names are not handled by the hardware.
- * So we simulate them by maintaining a file that
- * holds a list of the names.  This file is saved and retrieved
- * automatically whenever a patch name changes
- */
-void SynthModel::loadPatchNames()
-{
-    FILE *fp;
-    char bf[130];
-
-    fp=fopen(PATCHFILE, "rt");
-    if (fp == nullptr) {
-        for (int i=0; i<128; i++) {
-            m_patchNames[i]="Untitled";
-        }
-
-        m_patchNameBuffer="Untitled";
-        return;
-    }
-
-    while (fgets(bf, 130, fp) != nullptr) {
-        char *tk;
-
-        if (bf[0]) {
-            tk=&bf[strlen(bf)-1];
-            while (*tk == '\n' || *tk == '\r') {
-                *tk--=0;
-            }
-        }
-
-        tk=strchr(bf, '=');
-        if (tk == nullptr) {
-            continue;
-        }
-
-        *tk++=0;
-        int p=atoi(bf)-1;
-
-        if (p < 0 || p > 127) {
-            continue;
-        }
-
-        m_patchNames[p]=tk;
-    }
-
-    fclose(fp);
-
-    if (m_patchnumber >= 0 && m_patchnumber < 128) {
-        m_patchNameBuffer=m_patchNames[m_patchnumber];
-    }
-}
-
-void SynthModel::savePatchNames()
-{
-    FILE *fp;
-
-    fp=fopen(PATCHFILE, "wt");
-    if (fp == nullptr) {
-        return;
-    }
-
-    for (int p=0; p<128; p++) {
-        char bf[300];
-
-        sprintf(bf, "%d=%s", p+1, m_patchNames[p].c_str());
-        fprintf(fp, "%s\n", bf);
-    }
-
-    fclose(fp);
-}
-
 QString SynthModel::patchName()
 {
-    return QString(m_patchNameBuffer.c_str());
+    return QString(m_device->unit(m_device->activeUnit()).patchName.c_str());
 }
 
 void SynthModel::setPatchName(const QString &str)
 {
-    m_patchNameBuffer=str.toStdString();
+    m_device->unit(m_device->activeUnit()).patchName=str.toStdString();
 }
 
@@ -25,11 +25,17 @@
 #define SYNTHMODEL_H
 
 #include <QObject>
+#include <QByteArray>
 #include <QString>
 #include <QList>
-#include <QtSerialPort/QSerialPort>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QTimer>
 #include "xfm2.h"
 #include "xfmoperator.h"
+#include "xfmdevice.h"
+#include "xfmmorph.h"
 #include <string>
 #include <vector>
 
@@ -51,9 +57,28 @@ class SynthModel : public QObject {
     Q_OBJECT
 
     // Global info
-    Q_PROPERTY(bool isConnected READ isConnected)
+    Q_PROPERTY(bool isConnected READ isConnected NOTIFY connectionChanged)
+    Q_PROPERTY(int unit READ unit WRITE setUnit NOTIFY unitChanged)
+    Q_PROPERTY(int device READ device WRITE setDevice NOTIFY deviceChanged)
+    Q_PROPERTY(int deviceCount READ deviceCount CONSTANT)
+    Q_PROPERTY(QStringList devicePorts READ devicePorts NOTIFY connectionChanged)
     Q_PROPERTY(int patchNumber READ patchNumber WRITE setPatchNumber NOTIFY patchNumberChanged)
     Q_PROPERTY(QString patchName READ patchName WRITE setPatchName NOTIFY patchNameChanged)
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY historyChanged)
+    Q_PROPERTY(bool canRedo READ canRedo NOTIFY historyChanged)
+    Q_PROPERTY(bool comparing READ comparing NOTIFY compareChanged)
+    Q_PROPERTY(bool comparingB READ comparingB NOTIFY compareChanged)
+    Q_PROPERTY(double morphPosition READ morphPosition WRITE setMorphPosition NOTIFY morphPositionChanged)
+    Q_PROPERTY(int morphSources READ morphSources NOTIFY morphSourcesChanged)
+    Q_PROPERTY(int morphRate READ morphRate WRITE setMorphRate NOTIFY morphRateChanged)
+    Q_PROPERTY(bool automationRecording READ automationRecording NOTIFY automationChanged)
+    Q_PROPERTY(bool automationPlaying READ automationPlaying NOTIFY automationChanged)
+    Q_PROPERTY(int automationEvents READ automationEvents NOTIFY automationChanged)
+    Q_PROPERTY(int modulationRate READ modulationRate WRITE setModulationRate NOTIFY modulationRateChanged)
+    Q_PROPERTY(int sequencerLength READ sequencerLength WRITE setSequencerLength NOTIFY sequencerChanged)
+    Q_PROPERTY(double sequencerTempo READ sequencerTempo WRITE setSequencerTempo NOTIFY sequencerChanged)
+    Q_PROPERTY(bool sequencerTempoLock READ sequencerTempoLock WRITE setSequencerTempoLock NOTIFY sequencerChanged)
+    Q_PROPERTY(bool sequencerPlaying READ sequencerPlaying NOTIFY sequencerChanged)
 
     // Common
     Q_PROPERTY(int masterPitchBendUp READ masterPitchBendUp WRITE setMasterPitchBendUp NOTIFY masterPitchBendUpChanged)
@@ -200,6 +225,116 @@ public:
     // Restore the current patch (revert to saved version)
     Q_INVOKABLE bool reloadPatch();
 
+    // Replace the edit buffer with a 512 byte patch image.  Only the bytes
+    // that differ from the current edit buffer are sent to the synth
+    Q_INVOKABLE bool loadPatchImage(const QByteArray &image);
+
+    // Undo and redo edits to the current patch
+    Q_INVOKABLE bool undo();
+    Q_INVOKABLE bool redo();
+
+    // A/B compare the edits with a stored patch (the saved version of the
+    // current patch by default).  Toggling swaps which one the synth plays
+    // without losing the edits on either side
+    Q_INVOKABLE bool compareWith(int p=-1);
+    Q_INVOKABLE bool toggleCompare();
+    Q_INVOKABLE void endCompare(bool keepB=false);
+
+    // Morphing.  Add two or more patches (stored programs, or the current edit
+    // buffer) and then move morphPosition from 0 to morphSources-1 to sweep
+    // through them, or set a weight for every source.  The result is streamed
+    // to the synth morphRate times a second, sending only what changed
+    Q_INVOKABLE void morphClear();
+    Q_INVOKABLE bool morphAddPatch(int p);
+    Q_INVOKABLE bool morphAddCurrent();
+    Q_INVOKABLE bool setMorphWeights(const QVariantList &weights);
+
+    // Automation.  Recording captures every edit with its time, and playback
+    // repeats them on a timing thread of its own.  Stop ends either one
+    Q_INVOKABLE void recordAutomation();
+    Q_INVOKABLE bool playAutomation(bool loop=false);
+    Q_INVOKABLE void stopAutomation();
+    Q_INVOKABLE void clearAutomation();
+
+    // Playback timing: events played, and worst and average lateness in microseconds
+    Q_INVOKABLE QVariantMap automationStats();
+
+    // Modulators for any parameter on the active unit.  shape is one of
+    // "sine", "triangle", "saw", "square", "random", "envelope" or "steps",
+    // rate is in cycles per second and depth is the swing either side of the
+    // parameter's value.  addModulator returns an id for the other calls
+    Q_INVOKABLE int addModulator(int offset, const QString &shape, double rate, int depth);
+    Q_INVOKABLE bool removeModulator(int id);
+    Q_INVOKABLE void clearModulators();
+    Q_INVOKABLE bool setModulatorSteps(int id, const QVariantList &steps);
+    Q_INVOKABLE bool setModulatorEnvelope(int id, int attackms, int decayms);
+    Q_INVOKABLE void triggerModulators();
+
+    // Step sequencer.  Add a track for each parameter to sequence (on the
+    // active unit), then lock tracks to values on any of the steps
+    Q_INVOKABLE int sequencerAddTrack(int offset);
+    Q_INVOKABLE bool sequencerSetLock(int step, int track, int value);
+    Q_INVOKABLE void sequencerClear();
+    Q_INVOKABLE bool startSequencer();
+    Q_INVOKABLE void stopSequencer();
+
+    // Step timing: steps played, worst and average lateness and worst jitter, in microseconds
+    Q_INVOKABLE QVariantMap sequencerStats();
+
+    // Macros on the active unit.  Each target follows the macro from 'from'
+    // to 'to' along a curve ("linear", "exponential", "logarithmic" or
+    // "scurve").  A target offset of 512-515 means whatever parameter
+    // performance control 1-4 is assigned to.  addMacro returns an id for
+    // the other calls, and macros move from 0 to 255
+    Q_INVOKABLE int addMacro();
+    Q_INVOKABLE bool removeMacro(int id);
+    Q_INVOKABLE void clearMacros();
+    Q_INVOKABLE bool addMacroTarget(int id, int offset, int from, int to, const QString &curve);
+    Q_INVOKABLE bool clearMacroTargets(int id);
+    Q_INVOKABLE bool setMacro(int id, int value);
+    Q_INVOKABLE int macroValue(int id);
+
+    // Drive a macro from a MIDI CC (-1 unbinds), or from performance control 1-4 (0 unbinds)
+    Q_INVOKABLE bool bindMacroControlChange(int id, int cc);
+    Q_INVOKABLE bool bindMacroPerformanceControl(int id, int control);
+
+    // Feed in a MIDI control change.  Returns the number of macros it moved
+    Q_INVOKABLE int midiControlChange(int cc, int value);
+
+    // Smooth changes to a parameter over ms milliseconds along a curve (as
+    // for macro targets).  0 turns smoothing off
+    Q_INVOKABLE void setParameterSlew(int offset, int ms, const QString &curve="linear");
+    Q_INVOKABLE int parameterSlew(int offset);
+    Q_INVOKABLE void clearParameterSlews();
+
+    // Read any parameter on the active unit
+    Q_INVOKABLE int parameterValue(int offset);
+
+    // Write two parameters together, so they reach the synth in one write.
+    // An offset of -1 leaves that side out
+    Q_INVOKABLE bool writeParameterPair(int xoffset, int xvalue, int yoffset, int yvalue);
+
+    // Have the pages read every value again, e.g. after a run of writeParameterPair
+    Q_INVOKABLE void refreshPages();
+
+    // Play a note through the edit buffer and its effects with the offline
+    // renderer, without the synth.  Returns the peak and RMS level, the length in seconds and
+    // how long rendering took in milliseconds.  fixedPoint uses the
+    // renderer's integer engine, which is closer to the hardware
+    Q_INVOKABLE QVariantMap analysePatch(int note=60, int velocity=100, bool fixedPoint=false);
+
+    // How many voices of the edit buffer can be rendered in real time, on
+    // one core and shared out over every core.  The benchmark runs on a
+    // thread of its own and throughputMeasured() brings back the result.
+    // Returns false if a measurement is already running
+    Q_INVOKABLE bool renderThroughput(double seconds=1);
+
+    // Render a MIDI file through the edit buffer to a WAV file with the
+    // offline renderer.  The bounce runs on a thread of its own, from a copy
+    // of the edit buffer, and bounceFinished() says how it went.  Returns
+    // false straight away if the MIDI file couldn't be read
+    Q_INVOKABLE bool bounceMidi(const QString &midiFile, const QString &wavFile);
+
     // Send operator changes to the synth and update the memory buffer
     Q_INVOKABLE bool updateOperator(XFMOperator *op, bool notify=false);
 
@@ -215,8 +350,38 @@ public:
     // in the same way as the DX7 would, based on info at https://www.futur3soundz.com/da-blog/dx7-algorithms-in-xfm2
     Q_INVOKABLE bool makeDX7Algorithm(int a);
 
+    // Unit-scoped access.  The XFM2 has two units, each with its own edit buffer.
+    // The properties above all work on the active unit (see the unit property),
+    // these work on either unit without switching
+    Q_INVOKABLE int unitParameter(int unit, int offset);
+    Q_INVOKABLE bool setUnitParameter(int unit, int offset, int value);
+    Q_INVOKABLE int unitPatchNumber(int unit);
+    Q_INVOKABLE bool setUnitPatchNumber(int unit, int p);
+
+    // Back up the stored programs of every connected synth at once, one file
+    // per synth.  The backup carries on in the background and banksBackedUp()
+    // says how it went.  Returns false if a backup is already running
+    Q_INVOKABLE bool backupBanks(const QString &directory);
+
+    // Serial transport counters: frames, flushes, bytes and allocations
+    Q_INVOKABLE QVariantMap transportStats();
+
 
 signals:
+    void connectionChanged();
+    void historyChanged();
+    void compareChanged();
+    void morphPositionChanged();
+    void morphSourcesChanged();
+    void morphRateChanged();
+    void automationChanged();
+    void modulationRateChanged();
+    void sequencerChanged();
+    void deviceChanged();
+    void throughputMeasured(const QVariantMap &result);
+    void bounceFinished(const QString &wavFile, bool ok);
+    void banksBackedUp(const QString &directory, bool ok);
+    void unitChanged();
     void patchNumberChanged();
     void operatorSyncChanged();
     void operatorModeChanged();
@@ -321,9 +486,44 @@ signals:
 protected:
     bool isConnected() const;
 
+    int device() const;
+    void setDevice(int d);
+    int deviceCount() const;
+    QStringList devicePorts() const;
+
+    int unit() const;
+    void setUnit(int u);
+
     int patchNumber() const;
     void setPatchNumber(int p);
 
+    bool canUndo() const;
+    bool canRedo() const;
+
+    bool comparing() const;
+    bool comparingB() const;
+
+    double morphPosition() const;
+    void setMorphPosition(double position);
+    int morphSources() const;
+    int morphRate() const;
+    void setMorphRate(int rate);
+
+    bool automationRecording() const;
+    bool automationPlaying() const;
+    int automationEvents() const;
+
+    int modulationRate() const;
+    void setModulationRate(int hz);
+
+    int sequencerLength() const;
+    void setSequencerLength(int steps);
+    double sequencerTempo() const;
+    void setSequencerTempo(double bpm);
+    bool sequencerTempoLock() const;
+    void setSequencerTempoLock(bool locked);
+    bool sequencerPlaying() const;
+
     int operatorSync();
     void setOperatorSync(int v);
 
@@ -615,9 +815,6 @@ protected:
     int fxRoute();
     void setFxRoute(int v);
 
-    void loadPatchNames();
-    void savePatchNames();
-
     QString patchName();
     void setPatchName(const QString &str);
 
@@ -626,14 +823,28 @@ protected:
 
     QList<QObject *> fmOperators();
 
+private slots:
+    void checkConnections();
+    void schedulerDrained();
+    void automationFinished();
+    void syncSequencerTempo();
+    void macrosMoved(int u);
+
 private:
-    unsigned char               m_xfm2[512];        // Memory buffer
-    std::vector<std::string>    m_patchNames;       // XFM2 hardware doesn't hold patch names, so we use the app to store them
-    QSerialPort *               m_port;             // USB serial port connection
-    int                         m_patchnumber;      // Current patch number
-    bool                        m_isconnected;      // True if the hardware is connected
-    bool                        m_initialised;      // True if the model is initialised and the memory buffer has been read
-    std::string                 m_patchNameBuffer;  // The current patch name
+    void sendMorph(const unsigned char *image);
+
+    QList<XFMDevice *>          m_devices;          // Every synth we're controlling
+    XFMDevice *                 m_device;           // The synth being edited
+    int                         m_deviceIndex;      // Index of m_device in m_devices
+    unsigned char *             m_xfm2;             // Memory buffer for the active unit of m_device
+    QTimer *                    m_hotplugTimer;     // Watches for synths being unplugged and plugged back in
+    XFMMorph                    m_morph;            // Patches being morphed between
+    unsigned char               m_morphImage[512];  // Last morph result handed to the scheduler
+    double                      m_morphPosition;    // Where the morph is along its sources
+    int                         m_morphRate;        // Morph updates per second
+    bool                        m_morphPending;     // True until the scheduler has sent the last morph result
+    bool                        m_measuring;        // True while renderThroughput() has a thread running
+    bool                        m_backingUp;        // True while backupBanks() is waiting for the dumps
 };
 
 #endif // SYNTHMODEL_H
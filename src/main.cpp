@@ -25,11 +25,80 @@
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QFont>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
 #include "SynthModel.h"
+#include "xfmbounce.h"
+#include "xfmxypad.h"
 
+/*
+ * Headless bouncing, for when there's no synth or screen:
+ *
+ *   xfm2 --bounce song.mid bank1.bin song.wav 12    program 12 of a bank backup
+ *   xfm2 --bounce song.mid bank1.bin directory      every program in the bank
+ *   xfm2 --bounce song.mid patch.bin song.wav       a single 512 byte patch
+ */
+static int bounce(int argc, char *argv[])
+{
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s --bounce <song.mid> <bank or patch file> <output> [program 1-128]\n", argv[0]);
+        return 1;
+    }
+
+    XFMMidiFile midi;
+
+    if (!midi.load(argv[2])) {
+        fprintf(stderr, "Couldn't read MIDI file %s\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<unsigned char> patches(128*512);
+    FILE *fp=fopen(argv[3], "rb");
+    size_t count=0;
+
+    if (fp != nullptr) {
+        count=fread(&patches[0], 512, 128, fp);
+        fclose(fp);
+    }
+
+    if (count != 1 && count != 128) {
+        fprintf(stderr, "%s isn't a patch or a bank\n", argv[3]);
+        return 1;
+    }
+
+    int program=(argc > 5) ? atoi(argv[5]) : 0;
+
+    if (program < 0 || program > 128 || (count == 1 && program > 1)) {
+        fprintf(stderr, "No program %d in %s\n", program, argv[3]);
+        return 1;
+    }
+
+    XFMBounce bouncer(midi);
+    auto start=std::chrono::steady_clock::now();
+    int files;
+
+    if (count == 128 && program == 0) {
+        files=bouncer.renderBank(&patches[0], argv[4]);
+    } else {
+        files=bouncer.render(&patches[static_cast<size_t>(program > 0 ? program-1 : 0)*512], argv[4]) ? 1 : 0;
+    }
+
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    printf("Wrote %d file%s of a %.1f second song in %.1f seconds\n", files, files == 1 ? "" : "s", midi.length(), seconds);
+
+    return files > 0 ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--bounce") == 0) {
+        return bounce(argc, argv);
+    }
+
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 
     QGuiApplication app(argc, argv);
@@ -37,6 +106,9 @@ int main(int argc, char *argv[])
     // Register the FM Operator class
     qmlRegisterType<XFMOperator>("Xfm.Synth", 1, 0, "XFMOperator");
 
+    // And the XY pad, for driving two parameters with one finger
+    qmlRegisterType<XFMXYPad>("Xfm.Synth", 1, 0, "XFMXYPad");
+
     // Set the app's default font.  This is important for
     // correct scaling as some of the Qt forms are reliant
     // on point size.  We assume Ubuntu as the default font
@@ -1,6 +1,6 @@
 QT += quick serialport
 
-CONFIG += c++11
+CONFIG += c++14
 
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
@@ -13,10 +13,44 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Uncomment the following line to count heap allocations made by the serial
+# transport.  The counts are available from synthModel.transportStats()
+#DEFINES += XFM2_COUNT_ALLOCATIONS
+
+# The operator wave tables are built by the compiler (see xfmwavetable.cpp),
+# which takes more constexpr evaluation than clang and MSVC allow by default.
+# GCC's default limit is already high enough
+contains(QMAKE_COMPILER, clang): QMAKE_CXXFLAGS += -fconstexpr-steps=16777216
+msvc: QMAKE_CXXFLAGS += /constexpr:steps16777216
+
 SOURCES += \
         SynthModel.cpp \
         main.cpp \
-        xfmoperator.cpp
+        xfmalgorithm.cpp \
+        xfmautomation.cpp \
+        xfmbounce.cpp \
+        xfmclock.cpp \
+        xfmdevice.cpp \
+        xfmdiscovery.cpp \
+        xfmeffects.cpp \
+        xfmframering.cpp \
+        xfmhistory.cpp \
+        xfmkernels.cpp \
+        xfmmacro.cpp \
+        xfmmidifile.cpp \
+        xfmmodsources.cpp \
+        xfmmodulation.cpp \
+        xfmmorph.cpp \
+        xfmoperator.cpp \
+        xfmparameterinfo.cpp \
+        xfmpatchdiff.cpp \
+        xfmrenderer.cpp \
+        xfmscheduler.cpp \
+        xfmsequencer.cpp \
+        xfmtransport.cpp \
+        xfmwavetable.cpp \
+        xfmworkpool.cpp \
+        xfmxypad.cpp
 
 RESOURCES += qml.qrc \
 	images.qrc
@@ -35,4 +69,30 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 HEADERS += \
 	SynthModel.h \
 	xfm2.h \
-	xfmoperator.h
+	xfmalgorithm.h \
+	xfmautomation.h \
+	xfmbounce.h \
+	xfmclock.h \
+	xfmcurve.h \
+	xfmdevice.h \
+	xfmdiscovery.h \
+	xfmeffects.h \
+	xfmframering.h \
+	xfmhistory.h \
+	xfmkernels.h \
+	xfmmacro.h \
+	xfmmidifile.h \
+	xfmmodsources.h \
+	xfmmodulation.h \
+	xfmmorph.h \
+	xfmoperator.h \
+	xfmparameterinfo.h \
+	xfmpatchdiff.h \
+	xfmrenderer.h \
+	xfmscheduler.h \
+	xfmsequencer.h \
+	xfmtransport.h \
+	xfmunit.h \
+	xfmwavetable.h \
+	xfmworkpool.h \
+	xfmxypad.h
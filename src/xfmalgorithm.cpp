@@ -0,0 +1,132 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <string.h>
+#include "xfmalgorithm.h"
+
+namespace {
+
+std::mutex s_lock;
+std::unordered_map<uint64_t, std::unique_ptr<XFMAlgorithmPlan>> s_plans;
+
+}
+
+const XFMAlgorithmPlan *XFMAlgorithm::compile(const unsigned char *algo)
+{
+    uint64_t key=0;
+
+    for (int op=0; op<6; op++) {
+        key=(key << 8) | algo[op];
+    }
+
+    std::lock_guard<std::mutex> locker(s_lock);
+    std::unique_ptr<XFMAlgorithmPlan> &plan=s_plans[key];
+
+    if (!plan) {
+        plan.reset(new XFMAlgorithmPlan());
+        build(algo, *plan);
+    }
+
+    return plan.get();
+}
+
+int XFMAlgorithm::cached()
+{
+    std::lock_guard<std::mutex> locker(s_lock);
+    return static_cast<int>(s_plans.size());
+}
+
+/*
+ * A depth first search from each carrier puts every operator after its
+ * modulators.  Finding an operator that's still being visited means the
+ * algorithm loops back on itself.  Operators the search never reaches
+ * don't get a step
+ */
+void XFMAlgorithm::build(const unsigned char *algo, XFMAlgorithmPlan &plan)
+{
+    int state[6]={};    // 0 unvisited, 1 visiting, 2 placed
+    int stack[6];
+    int next[6];
+
+    memcpy(plan.algo, algo, sizeof(plan.algo));
+    plan.steps=0;
+    plan.carriers=0;
+    plan.serial=false;
+
+    for (int root=0; root<6; root++) {
+        if ((algo[root] & 1) == 0 || state[root] != 0) {
+            continue;
+        }
+
+        int depth=0;
+
+        stack[0]=root;
+        next[0]=0;
+        state[root]=1;
+
+        while (depth >= 0) {
+            int op=stack[depth];
+
+            if (next[depth] == 6) {
+                XFMAlgorithmStep &s=plan.step[plan.steps++];
+
+                s.op=op;
+                s.sources=0;
+                for (int m=0; m<6; m++) {
+                    if (m != op && (algo[op] & (2 << m)) != 0) {
+                        s.source[s.sources++]=m;
+                    }
+                }
+                s.feedback=(algo[op] & (2 << op)) != 0;
+                s.carrier=(algo[op] & 1) != 0;
+
+                if (s.carrier) {
+                    plan.carriers|=static_cast<unsigned char>(1 << op);
+                }
+
+                state[op]=2;
+                depth--;
+                continue;
+            }
+
+            int m=next[depth]++;
+
+            if (m == op || (algo[op] & (2 << m)) == 0) {
+                continue;
+            }
+
+            if (state[m] == 1) {
+                plan.serial=true;
+            } else if (state[m] == 0) {
+                depth++;
+                stack[depth]=m;
+                next[depth]=0;
+                state[m]=1;
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMALGORITHM_H
+#define XFMALGORITHM_H
+
+#include <stdint.h>
+
+// One operator's part in a compiled algorithm
+struct XFMAlgorithmStep {
+    int     op;
+    int     sources;        // How many operators modulate this one, not counting itself
+    int     source[5];
+    bool    feedback;       // Modulates itself
+    bool    carrier;        // Goes to the output
+};
+
+/*
+ * The ALGO1-6 bytes worked out into a list of steps.  Every operator comes
+ * after the operators that modulate it, and operators that can't be heard
+ * (neither a carrier nor modulating one, however indirectly) are left out.
+ * If the algorithm loops between operators, serial is set and an operator
+ * modulated by one later in the list takes that operator's last sample.
+ */
+struct XFMAlgorithmPlan {
+    unsigned char       algo[6];
+    XFMAlgorithmStep    step[6];
+    int                 steps;
+    unsigned char       carriers;   // Bit n for operator n
+    bool                serial;
+};
+
+/*
+ * Compiles algorithms into plans.  Plans are kept for as long as the
+ * program runs, keyed by the six ALGO bytes, so patches that share an
+ * algorithm share its plan.  A plan never moves once it's made and it's
+ * safe to compile from more than one thread.
+ */
+class XFMAlgorithm {
+public:
+    static const XFMAlgorithmPlan *compile(const unsigned char *algo);
+
+    // Plans made so far
+    static int cached();
+
+private:
+    static void build(const unsigned char *algo, XFMAlgorithmPlan &plan);
+};
+
+#endif // XFMALGORITHM_H
@@ -0,0 +1,200 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xfmautomation.h"
+#include "xfmclock.h"
+#include "xfmdevice.h"
+
+XFMAutomation::XFMAutomation(XFMDevice *device, QObject *parent) : QThread(parent)
+{
+    m_device=device;
+    m_transport=device->transport();
+    m_length=0;
+    m_recordStart=0;
+    m_recording=false;
+    m_loop=false;
+    m_stop=false;
+    m_played=0;
+    m_maxLate=0;
+    m_totalLate=0;
+    m_wakeups=0;
+
+    connect(this, &QThread::finished, this, &XFMAutomation::playbackFinished);
+}
+
+XFMAutomation::~XFMAutomation()
+{
+    m_stop=true;
+    wait();
+}
+
+void XFMAutomation::startRecording()
+{
+    stop();
+
+    m_events.clear();
+    m_events.reserve(4096);
+    m_length=0;
+    m_recordStart=XFMClock::now();
+    m_recording=true;
+}
+
+void XFMAutomation::stopRecording()
+{
+    if (m_recording) {
+        m_length=static_cast<quint32>((XFMClock::now()-m_recordStart)/1000);
+        m_recording=false;
+    }
+}
+
+bool XFMAutomation::isRecording() const
+{
+    return m_recording;
+}
+
+void XFMAutomation::record(int unit, int offset, unsigned char value)
+{
+    if (!m_recording) {
+        return;
+    }
+
+    XFMAutomationEvent e;
+
+    e.time=static_cast<quint32>((XFMClock::now()-m_recordStart)/1000);
+    e.slot=static_cast<quint16>(unit*512+offset);
+    e.value=value;
+    e.reserved=0;
+    m_events.push_back(e);
+}
+
+bool XFMAutomation::play(bool loop/*=false*/)
+{
+    stopRecording();
+    stop();
+
+    if (m_events.empty()) {
+        return false;
+    }
+
+    m_loop=loop;
+    m_stop=false;
+    m_played=0;
+    m_maxLate=0;
+    m_totalLate=0;
+    m_wakeups=0;
+
+    m_device->beginLanding();
+    start(QThread::TimeCriticalPriority);
+    return true;
+}
+
+void XFMAutomation::stop()
+{
+    if (isRunning()) {
+        m_stop=true;
+        wait();
+    }
+}
+
+bool XFMAutomation::isPlaying() const
+{
+    return isRunning();
+}
+
+void XFMAutomation::clear()
+{
+    stop();
+    stopRecording();
+    m_events.clear();
+    m_length=0;
+}
+
+int XFMAutomation::eventCount() const
+{
+    return static_cast<int>(m_events.size());
+}
+
+XFMAutomationStats XFMAutomation::stats() const
+{
+    XFMAutomationStats s;
+    quint64 wakeups=m_wakeups;
+
+    s.events=m_played;
+    s.maxLateNs=m_maxLate;
+    s.meanLateNs=wakeups ? m_totalLate/static_cast<qint64>(wakeups) : 0;
+
+    return s;
+}
+
+void XFMAutomation::playbackFinished()
+{
+    m_device->endLanding();
+}
+
+void XFMAutomation::run()
+{
+    const size_t count=m_events.size();
+    qint64 start=XFMClock::now();
+    size_t next=0;
+
+    // A loop can't be shorter than its last event
+    qint64 length=qMax(static_cast<qint64>(m_length), static_cast<qint64>(m_events[count-1].time)+1);
+
+    while (!m_stop) {
+        qint64 deadline=start+static_cast<qint64>(m_events[next].time)*1000;
+
+        if (!XFMClock::sleepUntil(deadline, &m_stop)) {
+            break;
+        }
+
+        qint64 now=XFMClock::now();
+        qint64 late=now-deadline;
+
+        // Everything that's due goes out in a single write
+        m_transport->hold();
+        while (next < count && start+static_cast<qint64>(m_events[next].time)*1000 <= now) {
+            const XFMAutomationEvent &e=m_events[next];
+
+            m_transport->queueParameter(e.slot/512, e.slot%512, e.value);
+            m_device->land(e.slot/512, e.slot%512, e.value);
+            m_played++;
+            next++;
+        }
+        m_transport->release();
+
+        m_wakeups++;
+        m_totalLate+=late;
+        if (late > m_maxLate) {
+            m_maxLate=late;
+        }
+
+        if (next == count) {
+            if (!m_loop) {
+                break;
+            }
+
+            start+=length*1000;
+            next=0;
+        }
+    }
+}
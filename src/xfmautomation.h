@@ -0,0 +1,112 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMAUTOMATION_H
+#define XFMAUTOMATION_H
+
+#include <QThread>
+#include <atomic>
+#include <vector>
+#include "xfmtransport.h"
+
+class XFMDevice;
+
+/*
+ * One recorded parameter change.  Eight bytes, so a few minutes of busy
+ * knob twiddling still fits in well under a megabyte.
+ */
+struct XFMAutomationEvent {
+    quint32     time;           // Microseconds from the start of the recording
+    quint16     slot;           // unit*512+offset
+    quint8      value;
+    quint8      reserved;
+};
+
+/*
+ * Playback timing.  Lateness is how far past its timestamp each group of
+ * events actually went to the transport.
+ */
+struct XFMAutomationStats {
+    quint64     events;         // Events played
+    qint64      maxLateNs;      // Worst lateness
+    qint64      meanLateNs;     // Average lateness
+};
+
+/*
+ * Records every edit made to a synth with its time, and plays the
+ * recording back on a thread of its own.
+ *
+ * Recording is fed by XFMDevice::writeLocation, so it picks up changes made
+ * from the pages, by MIDI or by scripts alike.  Playback runs at time
+ * critical priority and waits for each event with XFMClock::sleepUntil,
+ * then queues everything that's due straight onto the transport.  The
+ * played values land in the edit buffer through XFMDevice::land.
+ */
+class XFMAutomation : public QThread {
+    Q_OBJECT
+
+public:
+    explicit XFMAutomation(XFMDevice *device, QObject *parent = nullptr);
+    ~XFMAutomation() override;
+
+    void startRecording();
+    void stopRecording();
+    bool isRecording() const;
+
+    // Called for each edit while recording
+    void record(int unit, int offset, unsigned char value);
+
+    // Start playing the recording, optionally looping it
+    bool play(bool loop=false);
+    void stop();
+    bool isPlaying() const;
+
+    void clear();
+    int eventCount() const;
+
+    XFMAutomationStats stats() const;
+
+protected:
+    void run() override;
+
+private slots:
+    void playbackFinished();
+
+private:
+    XFMDevice *                         m_device;
+    XFMTransport *                      m_transport;
+    std::vector<XFMAutomationEvent>     m_events;           // The recording, in time order
+    quint32                             m_length;           // Length of the recording in microseconds
+    qint64                              m_recordStart;      // XFMClock time recording started
+    bool                                m_recording;
+    bool                                m_loop;
+    std::atomic<bool>                   m_stop;             // Tells the playback thread to finish
+
+    // Written by the playback thread
+    std::atomic<quint64>                m_played;
+    std::atomic<qint64>                 m_maxLate;
+    std::atomic<qint64>                 m_totalLate;
+    std::atomic<quint64>                m_wakeups;
+};
+
+#endif // XFMAUTOMATION_H
@@ -0,0 +1,238 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "xfmbounce.h"
+#include "xfmrenderer.h"
+#include "xfmworkpool.h"
+
+static void put16(unsigned char *p, uint32_t v)
+{
+    p[0]=static_cast<unsigned char>(v);
+    p[1]=static_cast<unsigned char>(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p+2, v >> 16);
+}
+
+// A 44 byte RIFF header for 16 bit stereo PCM
+static bool writeHeader(FILE *fp, uint32_t sampleRate, uint32_t frames)
+{
+    unsigned char h[44];
+    uint32_t bytes=frames*4;
+
+    memcpy(&h[0], "RIFF", 4);
+    put32(&h[4], 36+bytes);
+    memcpy(&h[8], "WAVEfmt ", 8);
+    put32(&h[16], 16);
+    put16(&h[20], 1);
+    put16(&h[22], 2);
+    put32(&h[24], sampleRate);
+    put32(&h[28], sampleRate*4);
+    put16(&h[32], 4);
+    put16(&h[34], 16);
+    memcpy(&h[36], "data", 4);
+    put32(&h[40], bytes);
+
+    return fwrite(h, sizeof(h), 1, fp) == 1;
+}
+
+static uint32_t toPCM(float v)
+{
+    if (v > 1) v=1;
+    if (v < -1) v=-1;
+
+    return static_cast<uint16_t>(static_cast<int16_t>(v*32767));
+}
+
+XFMBounce::XFMBounce(const XFMMidiFile &midi, float sampleRate/*=48000*/) : m_midi(midi)
+{
+    m_sampleRate=sampleRate;
+    m_tail=4;
+}
+
+void XFMBounce::setTail(double seconds)
+{
+    m_tail=seconds < 0 ? 0 : seconds;
+}
+
+/*
+ * Events land on the exact sample they're due: the renderer is run up to
+ * each one, rather than to the end of a block.  The header is written
+ * again at the end, once the length is known
+ */
+bool XFMBounce::render(const unsigned char *patch, const std::string &filename) const
+{
+    FILE *fp;
+
+    fp=fopen(filename.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    XFMRenderer renderer(m_sampleRate);
+    Pedal pedal;
+    const std::vector<XFMMidiEvent> &events=m_midi.events();
+    uint32_t rate=static_cast<uint32_t>(m_sampleRate);
+    uint64_t end=static_cast<uint64_t>((m_midi.length()+m_tail)*m_sampleRate);
+    uint64_t done=0;
+    size_t next=0;
+    float left[XFM_RENDER_BLOCK];
+    float right[XFM_RENDER_BLOCK];
+    unsigned char pcm[XFM_RENDER_BLOCK*4];
+    bool ok=writeHeader(fp, rate, 0);
+
+    memset(&pedal, 0, sizeof(pedal));
+    renderer.loadPatch(patch);
+
+    while (ok && done < end) {
+        uint64_t due=end;
+
+        for (; next<events.size(); next++) {
+            due=static_cast<uint64_t>(events[next].seconds*m_sampleRate);
+            if (due > done) {
+                break;
+            }
+            play(renderer, pedal, events[next]);
+        }
+
+        if (next == events.size()) {
+            due=end;
+            if (done >= static_cast<uint64_t>(m_midi.length()*m_sampleRate) && !renderer.ringing()) {
+                break;
+            }
+        }
+
+        int n=(due-done < XFM_RENDER_BLOCK) ? static_cast<int>(due-done) : XFM_RENDER_BLOCK;
+
+        renderer.render(left, right, n);
+        for (int i=0; i<n; i++) {
+            put16(&pcm[i*4], toPCM(left[i]));
+            put16(&pcm[i*4+2], toPCM(right[i]));
+        }
+
+        ok=fwrite(pcm, 4, static_cast<size_t>(n), fp) == static_cast<size_t>(n);
+        done+=static_cast<uint64_t>(n);
+    }
+
+    ok=ok && fseek(fp, 0, SEEK_SET) == 0 && writeHeader(fp, rate, static_cast<uint32_t>(done));
+    ok=(fclose(fp) == 0) && ok;
+
+    return ok;
+}
+
+int XFMBounce::renderBank(const unsigned char *bank, const std::string &directory) const
+{
+    return renderBank(bank, directory, XFMWorkPool::shared());
+}
+
+// A job per program.  Each has a renderer of its own, so they share nothing
+int XFMBounce::renderBank(const unsigned char *bank, const std::string &directory, XFMWorkPool &pool) const
+{
+    std::atomic<int> written(0);
+
+    pool.parallelFor(128, [&](int program, int) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "/patch%03d.wav", program+1);
+        if (render(&bank[program*512], directory+name)) {
+            written++;
+        }
+    });
+
+    return written;
+}
+
+void XFMBounce::play(XFMRenderer &renderer, Pedal &pedal, const XFMMidiEvent &event)
+{
+    int note=event.data1;
+
+    switch (event.status & 0xf0) {
+        case 0x90:
+            // A note on with no velocity is a note off
+            if (event.data2 != 0) {
+                pedal.held[note]=false;
+                renderer.noteOn(note, event.data2);
+                break;
+            }
+            // fall through
+        case 0x80:
+            if (pedal.down) {
+                pedal.held[note]=true;
+            } else {
+                renderer.noteOff(note);
+            }
+            break;
+
+        case 0xb0:
+            switch (event.data1) {
+                case 1:     renderer.setController(XFMRenderer::Wheel, event.data2/127.0f);    break;
+                case 2:     renderer.setController(XFMRenderer::Breath, event.data2/127.0f);   break;
+                case 4:     renderer.setController(XFMRenderer::Foot, event.data2/127.0f);     break;
+
+                case 64:
+                    pedal.down=event.data2 >= 64;
+                    for (int i=0; i<128 && !pedal.down; i++) {
+                        if (pedal.held[i]) {
+                            pedal.held[i]=false;
+                            renderer.noteOff(i);
+                        }
+                    }
+                    break;
+
+                // All notes off lets them release, all sound off cuts them
+                case 120:
+                    renderer.allNotesOff();
+                    break;
+
+                case 123:
+                    for (int i=0; i<128; i++) {
+                        pedal.held[i]=false;
+                        renderer.noteOff(i);
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+            break;
+
+        case 0xd0:
+            renderer.setController(XFMRenderer::Aftertouch, event.data1/127.0f);
+            break;
+
+        case 0xe0:
+            renderer.setPitchBend(((event.data2 << 7 | event.data1)-8192)/8192.0f);
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef XFMBOUNCE_H
+#define XFMBOUNCE_H
+
+#include <string>
+#include "xfmmidifile.h"
+
+class XFMRenderer;
+class XFMWorkPool;
+
+/*
+ * Renders a MIDI file through a patch with the offline renderer, straight
+ * to a 16 bit stereo WAV file, as fast as the renderer will go.
+ *
+ * Every channel plays the patch, as the synth does in omni mode.  The mod
+ * wheel (CC 1), breath (CC 2), foot (CC 4), channel pressure and pitch bend
+ * drive the patch's controller routings, and the sustain pedal (CC 64)
+ * holds notes.  Once the song ends the file runs on until the voices and
+ * effects have died away, or for the tail time if that comes first.
+ *
+ * The audio is streamed out a block at a time, so a long song takes no
+ * more memory than a short one, and a bank of bounces can run side by side.
+ */
+class XFMBounce {
+public:
+    explicit XFMBounce(const XFMMidiFile &midi, float sampleRate=48000);
+
+    // How long to let notes ring on after the song.  4 seconds by default
+    void setTail(double seconds);
+
+    // One 512 byte patch image to one file
+    bool render(const unsigned char *patch, const std::string &filename) const;
+
+    // Each of a bank's 128 programs (as saved by a bank backup) to
+    // directory/patch001.wav to patch128.wav, with the bounces shared out
+    // over the pool.  Returns how many were written
+    int renderBank(const unsigned char *bank, const std::string &directory) const;
+    int renderBank(const unsigned char *bank, const std::string &directory, XFMWorkPool &pool) const;
+
+private:
+    struct Pedal {
+        bool    down;
+        bool    held[128];      // Notes let go while the pedal was down
+    };
+
+    static void play(XFMRenderer &renderer, Pedal &pedal, const XFMMidiEvent &event);
+
+    const XFMMidiFile   &m_midi;
+    float               m_sampleRate;
+    double              m_tail;
+};
+
+#endif // XFMBOUNCE_H
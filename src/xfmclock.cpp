@@ -0,0 +1,64 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <thread>
+#include "xfmclock.h"
+
+// The last part of a wait that's spent spinning rather than sleeping
+#define SPINNS      1000000
+
+// Longest single sleep, so an abort is noticed quickly
+#define MAXSLEEPNS  10000000
+
+qint64 XFMClock::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool XFMClock::sleepUntil(qint64 deadline, const std::atomic<bool> *abort/*=nullptr*/)
+{
+    for (;;) {
+        if (abort != nullptr && abort->load(std::memory_order_relaxed)) {
+            return false;
+        }
+
+        qint64 remaining=deadline-now();
+
+        if (remaining <= 0) {
+            return true;
+        }
+
+        if (remaining > SPINNS) {
+            qint64 ns=remaining-SPINNS;
+
+            if (ns > MAXSLEEPNS) {
+                ns=MAXSLEEPNS;
+            }
+
+            std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
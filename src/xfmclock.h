@@ -0,0 +1,48 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMCLOCK_H
+#define XFMCLOCK_H
+
+#include <QtGlobal>
+#include <atomic>
+
+/*
+ * A monotonic clock for the timing threads (automation playback, the step
+ * sequencer).  Ordinary sleeps wake up whenever the scheduler gets round to
+ * it, which can be a millisecond or more late, so sleepUntil() sleeps for
+ * most of the wait and spins for the last stretch.  That costs a little CPU
+ * per event but keeps wakeups within a few microseconds of the deadline.
+ */
+
+class XFMClock {
+public:
+    // Nanoseconds since some fixed point
+    static qint64 now();
+
+    // Wait until now() reaches deadline.  Returns false straight away if
+    // abort is set, whether before or during the wait
+    static bool sleepUntil(qint64 deadline, const std::atomic<bool> *abort=nullptr);
+};
+
+#endif // XFMCLOCK_H
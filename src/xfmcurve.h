@@ -0,0 +1,53 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMCURVE_H
+#define XFMCURVE_H
+
+/*
+ * Response curves for anything that moves a parameter between two values
+ * (macros, slews).  Each one maps 0-1 onto 0-1.
+ */
+struct XFMCurve {
+    enum Shape { Linear, Exponential, Logarithmic, SCurve };
+
+    static double apply(Shape shape, double x)
+    {
+        switch (shape) {
+            case Exponential:
+                return x*x;
+
+            case Logarithmic:
+                return 1-(1-x)*(1-x);
+
+            case SCurve:
+                return x*x*(3-2*x);
+
+            default:
+                return x;
+        }
+    }
+};
+
+#endif // XFMCURVE_H
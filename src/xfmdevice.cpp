@@ -0,0 +1,880 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <QtSerialPort/QSerialPortInfo>
+#include <string.h>
+#include <stdio.h>
+#include <utility>
+#include "xfmdevice.h"
+#include "xfmdiscovery.h"
+#include "xfmpatchdiff.h"
+
+// How often values sent by the timing threads are copied into the edit buffers, in milliseconds
+#define LANDINGINTERVAL 50
+
+// How long the synth gets to answer on a new port name after a reconnect, in milliseconds
+#define RECONNECTPROBETIMEOUT 150
+
+XFMDevice::XFMDevice(const QString &portName, const std::string &patchFile, QObject *parent) : QObject(parent)
+{
+    // Allow for 128 patch names
+    m_patchNames.resize(128);
+    m_patchFile=patchFile;
+    m_portName=portName;
+    m_unit=0;
+    m_dumpUnit=0;
+    m_isconnected=false;
+
+    for (int u=0; u<XFM2_UNITS; u++) {
+        memset(m_units[u].buffer, 0, sizeof(m_units[u].buffer));
+        m_units[u].patchnumber=-1;
+        m_units[u].initialised=false;
+        m_units[u].comparing=false;
+        m_units[u].showingB=false;
+    }
+    memset(m_bank.valid, 0, sizeof(m_bank.valid));
+    memset(m_bank.dirty, 0, sizeof(m_bank.dirty));
+
+    m_transport=new XFMTransport(this);
+    m_scheduler=new XFMParameterScheduler(this, this);
+    m_automation=new XFMAutomation(this, this);
+    m_modulation=new XFMModulation(this, this);
+    m_sequencer=new XFMSequencer(this, this);
+    m_macros=new XFMMacros(this, this);
+
+    for (int i=0; i<XFM2_UNITS*512; i++) {
+        m_landed[i]=-1;
+    }
+    m_landingCount=0;
+    m_landingTimer=new QTimer(this);
+    m_landingTimer->setInterval(LANDINGINTERVAL);
+    connect(m_landingTimer, &QTimer::timeout, this, &XFMDevice::applyLanded);
+    m_editClock.start();
+
+    loadPatchNames();
+}
+
+// The timing threads use the transport, so they have to stop before it goes
+XFMDevice::~XFMDevice()
+{
+    m_automation->stop();
+    m_sequencer->stop();
+}
+
+// Open the serial port.  The transport thread is started the first time
+bool XFMDevice::open()
+{
+    m_isconnected=m_transport->open(m_portName);
+    if (!m_isconnected) {
+        qDebug() << "Cannot open " << m_portName << " for read/write";
+        return false;
+    }
+
+    QSerialPortInfo info(m_portName);
+    if (!info.serialNumber().isEmpty()) {
+        m_serialNumber=info.serialNumber();
+    }
+
+    return true;
+}
+
+/*
+ * The transport closes the port as soon as a read or write fails with a
+ * resource error, but an idle synth can be unplugged without us noticing,
+ * so we also look for the port in the system's list.  Once it's back the
+ * port is reopened and the synth brought up to date with our copy.
+ */
+bool XFMDevice::checkConnection()
+{
+    if (m_isconnected) {
+        if (m_transport->isOpen() && portPresent()) {
+            return false;
+        }
+
+        qDebug() << "XFM2 on" << m_portName << "has gone away";
+        m_transport->close();
+        m_isconnected=false;
+        return true;
+    }
+
+    QString port=findPort();
+
+    if (port.isEmpty()) {
+        return false;
+    }
+
+    m_portName=port;
+    if (!open()) {
+        return false;
+    }
+
+    qDebug() << "XFM2 is back on" << m_portName;
+    reconcile();
+    return true;
+}
+
+bool XFMDevice::portPresent() const
+{
+    QList<QSerialPortInfo> ports=QSerialPortInfo::availablePorts();
+
+    for (int i=0; i<ports.size(); i++) {
+        if (ports[i].portName() == m_portName) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Look for the synth on its old port, or by its USB serial number, since
+// plugging it into a different socket can give it a new port name
+QString XFMDevice::findPort() const
+{
+    QList<QSerialPortInfo> ports=QSerialPortInfo::availablePorts();
+    QStringList moved;
+
+    for (int i=0; i<ports.size(); i++) {
+        const QSerialPortInfo &info=ports[i];
+
+        if (info.portName() == m_portName) {
+            if (m_serialNumber.isEmpty() || info.serialNumber() == m_serialNumber) {
+                return m_portName;
+            }
+        } else if (!m_serialNumber.isEmpty() && info.serialNumber() == m_serialNumber) {
+            moved.append(info.portName());
+        }
+    }
+
+    // The FT2232's two channels share a serial number, so ask which one is the synth
+    for (int i=0; i<moved.size(); i++) {
+        if (XFMDiscovery::probe(moved[i], RECONNECTPROBETIMEOUT)) {
+            return moved[i];
+        }
+    }
+
+    return QString();
+}
+
+/*
+ * Bring the synth back in line with our copy after a reconnect.  Programs
+ * written while it was away are stored first, then each unit's edit buffer
+ * is read back and only the bytes that differ are sent.  A unit we've never
+ * read is loaded the usual way.
+ */
+bool XFMDevice::reconcile()
+{
+    unsigned char bf[5];
+
+    for (int p=0; p<128; p++) {
+        if (!m_bank.dirty[p]) {
+            continue;
+        }
+
+        bf[0]='r';
+        bf[1]=static_cast<unsigned char>(p);
+        if (!m_transport->command(0, bf, 2, bf, 1)) {
+            return false;
+        }
+
+        bf[0]='d';
+        if (!m_transport->command(0, bf, 1, m_scratch, 512)) {
+            return false;
+        }
+
+        int sent=sendDifferences(0, m_scratch, m_bank.programs[p]);
+
+        bf[0]='w';
+        bf[1]=static_cast<unsigned char>(p);
+        if (!m_transport->command(0, bf, 2, bf, 1)) {
+            return false;
+        }
+
+        qDebug() << "stored program" << p << "(" << sent << "changes )";
+        m_bank.dirty[p]=false;
+    }
+
+    for (int u=0; u<XFM2_UNITS; u++) {
+        XFMUnit &unit=m_units[u];
+
+        if (!unit.initialised) {
+            if (unit.patchnumber >= 0 && !loadProgram(u, unit.patchnumber)) {
+                return false;
+            }
+            continue;
+        }
+
+        bf[0]='d';
+        if (!m_transport->command(u, bf, 1, m_scratch, 512)) {
+            return false;
+        }
+
+        int sent=sendDifferences(u, m_scratch, unit.buffer);
+        qDebug() << "reconciled unit" << u << "(" << sent << "changes )";
+    }
+
+    return true;
+}
+
+// Send the bytes of wanted that the synth doesn't already have, in one batch
+int XFMDevice::sendDifferences(int u, const unsigned char *device, const unsigned char *wanted)
+{
+    unsigned short offsets[XFMPatchDiff::PatchSize];
+
+    // Any glides have to arrive first, or the synth wouldn't match our copy
+    m_scheduler->settle(u);
+
+    int n=XFMPatchDiff::diff(device, wanted, offsets);
+
+    if (n == 0) {
+        return 0;
+    }
+
+    m_transport->hold();
+    for (int i=0; i<n; i++) {
+        m_transport->queueParameter(u, offsets[i], wanted[offsets[i]]);
+    }
+    m_transport->release();
+
+    return n;
+}
+
+bool XFMDevice::isConnected() const
+{
+    return m_isconnected;
+}
+
+QString XFMDevice::portName() const
+{
+    return m_portName;
+}
+
+XFMTransport *XFMDevice::transport()
+{
+    return m_transport;
+}
+
+XFMParameterScheduler *XFMDevice::scheduler()
+{
+    return m_scheduler;
+}
+
+XFMAutomation *XFMDevice::automation()
+{
+    return m_automation;
+}
+
+XFMModulation *XFMDevice::modulation()
+{
+    return m_modulation;
+}
+
+void XFMDevice::land(int u, int offset, unsigned char data)
+{
+    m_landed[u*512+offset].store(data, std::memory_order_relaxed);
+}
+
+void XFMDevice::beginLanding()
+{
+    if (m_landingCount++ == 0) {
+        m_landingTimer->start();
+    }
+}
+
+void XFMDevice::endLanding()
+{
+    applyLanded();
+
+    if (m_landingCount > 0 && --m_landingCount == 0) {
+        m_landingTimer->stop();
+    }
+}
+
+// This only updates our copy, the synth already has the values
+void XFMDevice::applyLanded()
+{
+    for (int i=0; i<XFM2_UNITS*512; i++) {
+        int v=m_landed[i].exchange(-1, std::memory_order_relaxed);
+
+        if (v >= 0) {
+            m_units[i/512].buffer[i%512]=static_cast<unsigned char>(v);
+        }
+    }
+}
+
+XFMSequencer *XFMDevice::sequencer()
+{
+    return m_sequencer;
+}
+
+XFMMacros *XFMDevice::macros()
+{
+    return m_macros;
+}
+
+XFMUnit &XFMDevice::unit(int u)
+{
+    return m_units[u];
+}
+
+int XFMDevice::activeUnit() const
+{
+    return m_unit;
+}
+
+void XFMDevice::setActiveUnit(int u)
+{
+    if (u >= 0 && u < XFM2_UNITS) {
+        m_unit=u;
+    }
+}
+
+// Read a unit's edit buffer from the synth
+bool XFMDevice::readUnitBuffer(int u)
+{
+    if (!m_isconnected) {
+        return false;
+    }
+
+    if (!m_transport->isOpen()) {
+        m_units[u].initialised=true;
+        return false;
+    }
+
+    const unsigned char dump='d';
+
+    if (!m_transport->command(u, &dump, 1, m_units[u].buffer, 512)) {
+        return false;
+    }
+
+    qDebug() << "read patch buffer (" << m_portName << ":" << u << ":" << m_units[u].patchnumber << ")";
+    m_units[u].initialised=true;
+    return true;
+}
+
+// Recall a stored program into a unit.  The synth always has to be told,
+// but the dump is skipped if the program is already in the bank cache.
+// Offline, a cached program goes straight into the edit buffer for
+// reconcile() to send.  One that isn't cached can't be loaded until the
+// synth is back, so the unit is left as it was
+bool XFMDevice::loadProgram(int u, int p)
+{
+    if (!m_isconnected && !m_bank.valid[p]) {
+        return false;
+    }
+
+    // Whichever side is showing is about to be replaced, so don't swap back
+    endCompare(u, m_units[u].showingB);
+    m_units[u].patchnumber=p;
+    m_units[u].patchName=m_patchNames[p];
+    m_history[u].clear();
+
+    if (!m_isconnected) {
+        memcpy(m_units[u].buffer, m_bank.programs[p], 512);
+        m_units[u].initialised=true;
+        m_modulation->rebaseUnit(u);
+        return true;
+    }
+
+    unsigned char bf[5];
+
+    bf[0]='r';
+    bf[1]=static_cast<unsigned char>(p);
+    if (!m_transport->command(u, bf, 2, bf, 1)) {
+        return false;
+    }
+
+    if (m_bank.valid[p]) {
+        memcpy(m_units[u].buffer, m_bank.programs[p], 512);
+        m_units[u].initialised=true;
+    } else {
+        if (!readUnitBuffer(u)) {
+            return false;
+        }
+
+        memcpy(m_bank.programs[p], m_units[u].buffer, 512);
+        m_bank.valid[p]=true;
+    }
+
+    m_modulation->rebaseUnit(u);
+    return true;
+}
+
+// Initialize the edit buffer by calling the init synth API
+// and then read synth parameters back into memory
+bool XFMDevice::initUnit(int u)
+{
+    if (!m_isconnected) {
+        return false;
+    }
+
+    unsigned char bf[5];
+
+    bf[0]='i';
+    endCompare(u, m_units[u].showingB);
+    m_transport->command(u, bf, 1, bf, 1);
+    m_history[u].clear();
+
+    readUnitBuffer(u);
+
+    m_units[u].patchName="Untitled";
+    return true;
+}
+
+// Store a unit's edit buffer as program p
+bool XFMDevice::writeProgram(int u, int p)
+{
+    m_units[u].patchnumber=p;
+
+    if (!m_isconnected) {
+        // Keep it until the synth is plugged back in
+        if (m_units[u].initialised) {
+            memcpy(m_bank.programs[p], m_units[u].buffer, 512);
+            m_bank.valid[p]=true;
+            m_bank.dirty[p]=true;
+
+            m_patchNames[p]=m_units[u].patchName;
+            savePatchNames();
+        }
+        return true;
+    }
+
+    unsigned char bf[5];
+
+    // The synth stores its own edit buffer, so glides and modulation have
+    // to give way to our copy first
+    m_scheduler->settle(u);
+
+    bf[0]='w';
+    bf[1]=static_cast<unsigned char>(p);
+    m_transport->command(u, bf, 2, bf, 1);
+
+    m_patchNames[p]=m_units[u].patchName;
+    savePatchNames();
+
+    readUnitBuffer(u);
+
+    // The stored program now matches the edit buffer
+    memcpy(m_bank.programs[p], m_units[u].buffer, 512);
+    m_bank.valid[p]=true;
+
+    return true;
+}
+
+unsigned char XFMDevice::readLocation(int u, int offset, bool useCache/*=true*/)
+{
+    unsigned char *buffer=m_units[u].buffer;
+
+    if ((!useCache || !m_units[u].initialised) && m_isconnected) {
+        unsigned char bf[5];
+        int len;
+
+        bf[0]='g';
+        if (offset < 256) {
+            bf[1]=static_cast<unsigned char>(offset);
+            len=2;
+        } else {
+            bf[1]=0xff;
+            bf[2]=static_cast<unsigned char>(offset-256);
+            len=3;
+        }
+
+        if (m_transport->command(u, bf, len, bf, 1)) {
+            buffer[offset]=bf[0];
+        }
+    }
+
+    return buffer[offset];
+}
+
+// Write-through to the synth, skipping values it already has.  Edits
+// (record is true) go into the undo history and take over from anything
+// the scheduler still has waiting for the parameter
+bool XFMDevice::writeLocation(int u, int offset, unsigned char data, bool record/*=true*/)
+{
+    unsigned char *buffer=m_units[u].buffer;
+
+    if (data == buffer[offset]) {
+        return true;
+    }
+
+    unsigned char old=buffer[offset];
+
+    if (record) {
+        m_history[u].record(offset, old, data, m_editClock.elapsed());
+    }
+    buffer[offset]=data;
+
+    if (record) {
+        m_scheduler->forget(u, offset);
+        m_automation->record(u, offset, data);
+        m_modulation->rebase(u, offset, data);
+        m_macros->follow(u, offset, data);
+    }
+
+    if (!m_isconnected || !m_units[u].initialised) {
+        return true;
+    }
+
+    // Hand edits to a slewed parameter glide there.  Anything else
+    // goes straight out and cuts short a glide that's under way
+    if (record && m_scheduler->slew(offset) > 0) {
+        m_scheduler->glide(u, offset, old);
+        return true;
+    }
+
+    m_scheduler->stopGlide(u, offset);
+    m_transport->queueParameter(u, offset, data);
+
+    return true;
+}
+
+// Upload a whole patch.  Only the bytes that differ from our copy of the edit
+// buffer go to the synth, and they all go out in a single write
+int XFMDevice::loadPatchImage(int u, const unsigned char *image)
+{
+    unsigned short offsets[XFMPatchDiff::PatchSize];
+    int n=XFMPatchDiff::diff(m_units[u].buffer, image, offsets);
+    long long now=m_editClock.elapsed();
+
+    // The whole image is one undo step
+    m_history[u].checkpoint();
+    for (int i=0; i<n; i++) {
+        m_history[u].record(offsets[i], m_units[u].buffer[offsets[i]], image[offsets[i]], now);
+    }
+    m_history[u].checkpoint();
+
+    return applyPatchImage(u, image);
+}
+
+// Undo and redo build the patch they want in m_scratch and upload it like
+// any other image, so only the bytes in the step are sent
+bool XFMDevice::undo(int u)
+{
+    memcpy(m_scratch, m_units[u].buffer, 512);
+    if (!m_history[u].undo(m_scratch)) {
+        return false;
+    }
+
+    applyPatchImage(u, m_scratch);
+    return true;
+}
+
+bool XFMDevice::redo(int u)
+{
+    memcpy(m_scratch, m_units[u].buffer, 512);
+    if (!m_history[u].redo(m_scratch)) {
+        return false;
+    }
+
+    applyPatchImage(u, m_scratch);
+    return true;
+}
+
+bool XFMDevice::canUndo(int u) const
+{
+    return m_history[u].canUndo();
+}
+
+bool XFMDevice::canRedo(int u) const
+{
+    return m_history[u].canRedo();
+}
+
+bool XFMDevice::startCompare(int u, int p/*=-1*/)
+{
+    XFMUnit &unit=m_units[u];
+
+    if (p < 0) {
+        p=unit.patchnumber;
+    }
+    if (p < 0 || p > 127 || !unit.initialised) {
+        return false;
+    }
+
+    if (unit.comparing) {
+        endCompare(u, unit.showingB);
+    }
+
+    if (!readProgramImage(u, p, unit.other)) {
+        return false;
+    }
+
+    m_otherHistory[u].clear();
+    unit.comparing=true;
+    unit.showingB=false;
+    return true;
+}
+
+bool XFMDevice::readProgramImage(int u, int p, unsigned char *image)
+{
+    if (p < 0 || p > 127) {
+        return false;
+    }
+
+    if (m_bank.valid[p]) {
+        memcpy(image, m_bank.programs[p], 512);
+        return true;
+    }
+
+    if (!m_isconnected || !m_units[u].initialised) {
+        return false;
+    }
+
+    // Recall the program, dump it, and then put the edit buffer straight back
+    unsigned char bf[5];
+
+    bf[0]='r';
+    bf[1]=static_cast<unsigned char>(p);
+    if (!m_transport->command(u, bf, 2, bf, 1)) {
+        return false;
+    }
+
+    bf[0]='d';
+    if (!m_transport->command(u, bf, 1, image, 512)) {
+        return false;
+    }
+
+    memcpy(m_bank.programs[p], image, 512);
+    m_bank.valid[p]=true;
+
+    sendDifferences(u, image, m_units[u].buffer);
+    return true;
+}
+
+// Swap the two sides.  The synth only needs the bytes that differ
+bool XFMDevice::toggleCompare(int u)
+{
+    XFMUnit &unit=m_units[u];
+
+    if (!unit.comparing) {
+        return false;
+    }
+
+    if (m_isconnected) {
+        sendDifferences(u, unit.buffer, unit.other);
+    }
+
+    memcpy(m_scratch, unit.buffer, 512);
+    memcpy(unit.buffer, unit.other, 512);
+    memcpy(unit.other, m_scratch, 512);
+
+    std::swap(m_history[u], m_otherHistory[u]);
+    unit.showingB=!unit.showingB;
+    return true;
+}
+
+void XFMDevice::endCompare(int u, bool keepB/*=false*/)
+{
+    XFMUnit &unit=m_units[u];
+
+    if (!unit.comparing) {
+        return;
+    }
+
+    if (unit.showingB != keepB) {
+        toggleCompare(u);
+    }
+
+    m_otherHistory[u].clear();
+    unit.comparing=false;
+    unit.showingB=false;
+}
+
+// Copy an image into the edit buffer and send the synth whatever changed
+int XFMDevice::applyPatchImage(int u, const unsigned char *image)
+{
+    XFMUnit &unit=m_units[u];
+    int sent=0;
+
+    if (m_isconnected && unit.initialised) {
+        sent=sendDifferences(u, unit.buffer, image);
+    }
+
+    memcpy(unit.buffer, image, 512);
+    return sent;
+}
+
+// Kick off a dump of all 128 programs.  The transport uses the active unit
+// to recall each program.  The dump has a buffer of its own, since the GUI
+// keeps using the bank cache while it runs
+void XFMDevice::startBankBackup()
+{
+    memset(m_bank.valid, 0, sizeof(m_bank.valid));
+    m_dumpUnit=m_unit;
+    m_transport->startBankDump(m_dumpUnit, &m_dump[0][0]);
+}
+
+bool XFMDevice::waitForBankBackup()
+{
+    return m_transport->waitForBankDump();
+}
+
+// Anything that was cached while the dump ran (a program read or written
+// from the GUI) is newer than the dumped copy, so it's kept
+bool XFMDevice::finishBankBackup(bool dumped, const std::string &filename)
+{
+    if (!dumped) {
+        restoreEditBuffer(m_dumpUnit);
+        return false;
+    }
+
+    for (int p=0; p<128; p++) {
+        if (!m_bank.valid[p]) {
+            memcpy(m_bank.programs[p], m_dump[p], 512);
+            m_bank.valid[p]=true;
+        }
+    }
+
+    restoreEditBuffer(m_dumpUnit);
+
+    FILE *fp;
+
+    fp=fopen(filename.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    size_t written=fwrite(&m_bank.programs[0][0], 512, 128, fp);
+    fclose(fp);
+
+    return written == 128;
+}
+
+// Put the synth's edit buffer back to match our copy after it has been
+// overwritten (e.g. by a bank dump).  If the program is in the bank cache
+// it's recalled and only the bytes that were edited are sent.  Otherwise
+// (say a dump failed part way) whatever the synth has is read back and
+// everything that differs is sent
+bool XFMDevice::restoreEditBuffer(int u)
+{
+    XFMUnit &unit=m_units[u];
+
+    if (!m_isconnected || !unit.initialised) {
+        return false;
+    }
+
+    unsigned char bf[5];
+
+    if (unit.patchnumber >= 0 && m_bank.valid[unit.patchnumber]) {
+        bf[0]='r';
+        bf[1]=static_cast<unsigned char>(unit.patchnumber);
+        if (!m_transport->command(u, bf, 2, bf, 1)) {
+            return false;
+        }
+
+        sendDifferences(u, m_bank.programs[unit.patchnumber], unit.buffer);
+        return true;
+    }
+
+    bf[0]='d';
+    if (!m_transport->command(u, bf, 1, m_scratch, 512)) {
+        return false;
+    }
+
+    sendDifferences(u, m_scratch, unit.buffer);
+    return true;
+}
+
+std::string XFMDevice::patchName(int p) const
+{
+    return m_patchNames[p];
+}
+
+void XFMDevice::setPatchName(int p, const std::string &name)
+{
+    m_patchNames[p]=name;
+}
+
+/*
+ * Patch names are not handled by the hardware.
+ * So we simulate them by maintaining a file that
+ * holds a list of the names.  This file is saved and retrieved
+ * automatically whenever a patch name changes
+ */
+void XFMDevice::loadPatchNames()
+{
+    FILE *fp;
+    char bf[130];
+
+    fp=fopen(m_patchFile.c_str(), "rt");
+    if (fp == nullptr) {
+        for (int i=0; i<128; i++) {
+            m_patchNames[i]="Untitled";
+        }
+
+        return;
+    }
+
+    while (fgets(bf, 130, fp) != nullptr) {
+        char *tk;
+
+        if (bf[0]) {
+            tk=&bf[strlen(bf)-1];
+            while (*tk == '\n' || *tk == '\r') {
+                *tk--=0;
+            }
+        }
+
+        tk=strchr(bf, '=');
+        if (tk == nullptr) {
+            continue;
+        }
+
+        *tk++=0;
+        int p=atoi(bf)-1;
+
+        if (p < 0 || p > 127) {
+            continue;
+        }
+
+        m_patchNames[p]=tk;
+    }
+
+    fclose(fp);
+
+    for (int u=0; u<XFM2_UNITS; u++) {
+        if (m_units[u].patchnumber >= 0 && m_units[u].patchnumber < 128) {
+            m_units[u].patchName=m_patchNames[m_units[u].patchnumber];
+        }
+    }
+}
+
+void XFMDevice::savePatchNames()
+{
+    FILE *fp;
+
+    fp=fopen(m_patchFile.c_str(), "wt");
+    if (fp == nullptr) {
+        return;
+    }
+
+    for (int p=0; p<128; p++) {
+        char bf[300];
+
+        sprintf(bf, "%d=%s", p+1, m_patchNames[p].c_str());
+        fprintf(fp, "%s\n", bf);
+    }
+
+    fclose(fp);
+}
@@ -0,0 +1,179 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMDEVICE_H
+#define XFMDEVICE_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "xfmautomation.h"
+#include "xfmhistory.h"
+#include "xfmmacro.h"
+#include "xfmmodulation.h"
+#include "xfmscheduler.h"
+#include "xfmsequencer.h"
+#include "xfmtransport.h"
+#include "xfmunit.h"
+
+/*
+ * One XFM2 synth attached to the controller.
+ *
+ * The device holds everything we know about a synth: the transport (and its
+ * thread) for the serial port, a copy of each unit's edit buffer, the bank
+ * cache and the patch names.  The SynthModel can hold several of these and
+ * switch between them without reconnecting or reading anything back.
+ */
+class XFMDevice : public QObject {
+    Q_OBJECT
+
+public:
+    XFMDevice(const QString &portName, const std::string &patchFile, QObject *parent = nullptr);
+    ~XFMDevice() override;
+
+    bool open();
+    bool isConnected() const;
+    QString portName() const;
+
+    // Called regularly to notice the synth being unplugged or plugged back
+    // in.  Returns true if the connection state changed
+    bool checkConnection();
+
+    XFMTransport *transport();
+    XFMUnit &unit(int u);
+
+    // The unit the UI is editing on this synth
+    int activeUnit() const;
+    void setActiveUnit(int u);
+
+    // Edit buffer and program access.  See SynthModel for the details
+    bool readUnitBuffer(int u);
+    bool loadProgram(int u, int p);
+    bool initUnit(int u);
+    bool writeProgram(int u, int p);
+    unsigned char readLocation(int u, int offset, bool useCache=true);
+    bool writeLocation(int u, int offset, unsigned char data, bool record=true);
+
+    // Copy stored program p into image.  Uses the bank cache if it can,
+    // otherwise the program is fetched through unit u's edit buffer
+    bool readProgramImage(int u, int p, unsigned char *image);
+
+    // Coalescing writer for generated changes (morphs, modulators etc)
+    XFMParameterScheduler *scheduler();
+
+    // Records edits and plays them back
+    XFMAutomation *automation();
+
+    // Modulators running against this synth's parameters
+    XFMModulation *modulation();
+
+    // Parameter step sequencer
+    XFMSequencer *sequencer();
+
+    // Macros driving several parameters from one control
+    XFMMacros *macros();
+
+    // Values sent by the timing threads (automation, sequencer) go straight
+    // to the transport, and land() passes them back from any thread so the
+    // edit buffer can catch up.  They're copied in on the GUI thread every
+    // LANDINGINTERVAL while at least one timing thread has begun landing
+    void land(int u, int offset, unsigned char data);
+    void beginLanding();
+    void endLanding();
+
+    // Replace a unit's edit buffer with a 512 byte patch image, sending only
+    // the bytes that change.  Returns the number of bytes sent
+    int loadPatchImage(int u, const unsigned char *image);
+
+    // Step back and forward through a unit's edits.  Loading a program or
+    // initialising the unit starts a fresh history
+    bool undo(int u);
+    bool redo(int u);
+    bool canUndo(int u) const;
+    bool canRedo(int u) const;
+
+    // A/B compare a unit's edits (A) with stored program p (B), or with the
+    // stored copy of the program being edited if p is negative.  Each side
+    // keeps its own edits and undo history, and toggling only sends the bytes
+    // where the two sides differ.  Ending the comparison keeps one side
+    bool startCompare(int u, int p=-1);
+    bool toggleCompare(int u);
+    void endCompare(int u, bool keepB=false);
+
+    // Whole bank backup, run on the transport thread so several devices can
+    // dump at the same time.  The wait may be made from any thread, so the
+    // GUI can carry on while the dump runs.  Finishing is back on the GUI
+    // thread, with what the wait returned; it fills in the bank cache, writes
+    // the bank to a file and puts the active unit's edit buffer back the way
+    // it was
+    void startBankBackup();
+    bool waitForBankBackup();
+    bool finishBankBackup(bool dumped, const std::string &filename);
+
+    // Patch names
+    std::string patchName(int p) const;
+    void setPatchName(int p, const std::string &name);
+    void loadPatchNames();
+    void savePatchNames();
+
+private slots:
+    void applyLanded();
+
+private:
+    bool restoreEditBuffer(int u);
+    int applyPatchImage(int u, const unsigned char *image);
+    bool portPresent() const;
+    QString findPort() const;
+    bool reconcile();
+    int sendDifferences(int u, const unsigned char *device, const unsigned char *wanted);
+
+    XFMTransport *              m_transport;        // USB serial port connection
+    XFMParameterScheduler *     m_scheduler;        // Paces generated parameter changes
+    XFMAutomation *             m_automation;       // Edit recorder and playback thread
+    XFMModulation *             m_modulation;       // Controller side modulators
+    XFMSequencer *              m_sequencer;        // Parameter step sequencer
+    XFMMacros *                 m_macros;           // One control to many parameters
+    std::atomic<int>            m_landed[XFM2_UNITS*512];   // Last value sent by a timing thread for each parameter, or -1
+    QTimer *                    m_landingTimer;     // Copies landed values into the edit buffers
+    int                         m_landingCount;     // Timing threads that are landing values
+    XFMUnit                     m_units[XFM2_UNITS];    // Edit buffers for each unit
+    XFMBankCache                m_bank;             // Cached copies of the stored programs
+    XFMHistory                  m_history[XFM2_UNITS];  // Undo/redo for each unit
+    XFMHistory                  m_otherHistory[XFM2_UNITS]; // Undo/redo for the side of an A/B comparison that isn't playing
+    QElapsedTimer               m_editClock;        // Groups edits into undo steps
+    std::vector<std::string>    m_patchNames;       // XFM2 hardware doesn't hold patch names, so we use the app to store them
+    std::string                 m_patchFile;        // File the patch names are kept in
+    QString                     m_portName;         // Serial port the synth is on
+    QString                     m_serialNumber;     // USB serial number, to find the synth again if its port name changes
+    unsigned char               m_scratch[512];     // What the synth holds, while reconciling after a reconnect
+    unsigned char               m_dump[128][512];   // Programs read by a bank backup, written by the transport thread
+    int                         m_dumpUnit;         // The unit whose edit buffer a bank backup is overwriting
+    int                         m_unit;             // The unit being edited
+    bool                        m_isconnected;      // True if the hardware is connected
+};
+
+#endif // XFMDEVICE_H
@@ -0,0 +1,183 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <QtSerialPort/QSerialPort>
+#include <QtSerialPort/QSerialPortInfo>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfmdiscovery.h"
+#include "xfm2.h"
+
+// How long a single port gets to answer the probe, in milliseconds
+#define PROBETIMEOUT 150
+
+// The XFM2 runs on a board with an FTDI FT2232 USB interface.  The first
+// channel is JTAG, the second is the UART (which is why it's usually ttyUSB1)
+#define FTDI_VENDOR     0x0403
+#define FT2232_PRODUCT  0x6010
+
+/*
+ * Shared between the caller and the probe threads.  Probes that are still
+ * running when the caller gives up keep the state alive until they finish.
+ */
+struct XFMDiscoveryState {
+    std::mutex              lock;
+    std::condition_variable finished;
+    std::vector<int>        answered;   // Index into the candidate list for each port that answered
+    int                     remaining;  // Probes still running
+};
+
+QStringList XFMDiscovery::candidates()
+{
+    QStringList preferred;
+    QStringList others;
+    QList<QSerialPortInfo> ports=QSerialPortInfo::availablePorts();
+
+    for (int i=0; i<ports.size(); i++) {
+        const QSerialPortInfo &info=ports[i];
+
+        // Built in UARTs (e.g. the Pi's console) have no USB vendor, so leave them alone
+        if (!info.hasVendorIdentifier()) {
+            continue;
+        }
+
+        if (info.vendorIdentifier() == FTDI_VENDOR && info.productIdentifier() == FT2232_PRODUCT) {
+            preferred.append(info.portName());
+        } else {
+            others.append(info.portName());
+        }
+    }
+
+    // Each FT2232 shows up as two ports and the UART is the second one of
+    // each pair, so those go to the front of the list
+    QStringList list;
+
+    preferred.sort();
+    for (int i=1; i<preferred.size(); i+=2) {
+        list.append(preferred[i]);
+    }
+    for (int i=0; i<preferred.size(); i+=2) {
+        list.append(preferred[i]);
+    }
+    list.append(others);
+
+    return list;
+}
+
+// Ask for ALGO1.  A synth always answers 'g' with exactly one byte
+bool XFMDiscovery::probe(const QString &portName, int timeoutms)
+{
+    QSerialPort port;
+
+    port.setPortName(portName);
+    port.setBaudRate(500000);
+    port.setDataBits(QSerialPort::Data8);
+    port.setStopBits(QSerialPort::StopBits::OneStop);
+    port.setParity(QSerialPort::Parity::NoParity);
+
+    if (!port.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    const char bf[2]={ 'g', static_cast<char>(ALGO1) };
+
+    port.clear();
+    port.write(bf, 2);
+    port.waitForBytesWritten(timeoutms);
+
+    if (!port.waitForReadyRead(timeoutms)) {
+        return false;
+    }
+
+    // Give a chatty device the chance to show it isn't an XFM2
+    port.waitForReadyRead(timeoutms/4);
+
+    return port.bytesAvailable() == 1;
+}
+
+QString XFMDiscovery::findDevice(int budgetms)
+{
+    QStringList found=discover(budgetms, true);
+
+    return found.isEmpty() ? QString() : found[0];
+}
+
+QStringList XFMDiscovery::findDevices(int budgetms)
+{
+    return discover(budgetms, false);
+}
+
+QStringList XFMDiscovery::discover(int budgetms, bool firstOnly)
+{
+    QStringList ports=candidates();
+    QStringList found;
+
+    if (ports.isEmpty()) {
+        return found;
+    }
+
+    std::shared_ptr<XFMDiscoveryState> state=std::make_shared<XFMDiscoveryState>();
+
+    state->remaining=ports.size();
+
+    for (int i=0; i<ports.size(); i++) {
+        QString name=ports[i];
+
+        std::thread([state, name, i]() {
+            bool ok=probe(name, PROBETIMEOUT);
+
+            std::lock_guard<std::mutex> locker(state->lock);
+            if (ok) {
+                state->answered.push_back(i);
+            }
+            state->remaining--;
+            state->finished.notify_all();
+        }).detach();
+    }
+
+    // Wait until every probe is done, or (when we only want one) any port
+    // has answered, or the budget runs out
+    std::unique_lock<std::mutex> locker(state->lock);
+    auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(budgetms);
+
+    state->finished.wait_until(locker, deadline, [&state, firstOnly]() {
+        return state->remaining == 0 || (firstOnly && !state->answered.empty());
+    });
+
+    std::vector<int> answered=state->answered;
+    locker.unlock();
+
+    std::sort(answered.begin(), answered.end());
+    for (size_t i=0; i<answered.size(); i++) {
+        found.append(ports[answered[i]]);
+    }
+
+    qDebug() << "XFM2 discovery found" << found.size() << "of" << ports.size() << "ports";
+    return found;
+}
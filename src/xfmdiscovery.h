@@ -0,0 +1,59 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMDISCOVERY_H
+#define XFMDISCOVERY_H
+
+#include <QString>
+#include <QStringList>
+
+/*
+ * Finds XFM2 synths on the USB serial ports.
+ *
+ * Every USB serial port is probed at the same time, each on its own thread,
+ * with a 'g' command asking for a single parameter, then a short wait for
+ * the one byte reply.  findDevice() takes the first port to answer, so if
+ * several synths are plugged in it's whichever replies quickest.
+ * findDevices() waits for them all and lists ports on the FTDI chip the
+ * XFM2 board uses first.  The probe only reads, so it doesn't change
+ * anything on a synth that's playing.
+ */
+class XFMDiscovery {
+public:
+    // Return the first port that answers, or an empty string if none do within budgetms
+    static QString findDevice(int budgetms);
+
+    // Return every port that answers within budgetms, best candidates first
+    static QStringList findDevices(int budgetms);
+
+    // Probe a single port
+    static bool probe(const QString &portName, int timeoutms);
+
+    // The USB serial ports worth probing, best candidates first
+    static QStringList candidates();
+
+private:
+    static QStringList discover(int budgetms, bool firstOnly);
+};
+
+#endif // XFMDISCOVERY_H
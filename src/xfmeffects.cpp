@@ -0,0 +1,550 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+#include "xfmeffects.h"
+#include "xfmkernels.h"
+#include "xfm2.h"
+
+// Samples between updates of LFOs and sweeps
+#define BLOCK 64
+
+// Below this a sample in a delay line no longer counts as audible, about -100 dB
+#define QUIET 1e-5f
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// LFO speeds run from 0.05 Hz to 10 Hz, evenly spaced in octaves
+static float lfoHz(int raw)
+{
+    return 0.05f*powf(200.0f, raw/255.0f);
+}
+
+// Filter cutoffs run from 20 Hz to 20 kHz
+static float cutoffHz(int raw)
+{
+    return 20.0f*powf(1000.0f, raw/255.0f);
+}
+
+static float wrap(float phase)
+{
+    return phase-floorf(phase);
+}
+
+void XFMEffects::DelayLine::create(int samples)
+{
+    int size=1;
+
+    while (size < samples+2) {
+        size<<=1;
+    }
+
+    buffer.assign(static_cast<size_t>(size), 0);
+    mask=size-1;
+    pos=0;
+    sinceLoud=size;
+}
+
+void XFMEffects::DelayLine::clear()
+{
+    memset(buffer.data(), 0, sizeof(float)*buffer.size());
+    pos=0;
+    sinceLoud=mask+1;
+}
+
+void XFMEffects::DelayLine::write(float v)
+{
+    buffer[static_cast<size_t>(pos)]=v;
+    pos=(pos+1) & mask;
+
+    if (fabsf(v) > QUIET) {
+        sinceLoud=0;
+    } else if (sinceLoud <= mask) {
+        sinceLoud++;
+    }
+}
+
+float XFMEffects::DelayLine::tap(int delay) const
+{
+    return buffer[static_cast<size_t>((pos-delay) & mask)];
+}
+
+float XFMEffects::DelayLine::read(float delay) const
+{
+    int i=static_cast<int>(delay);
+    float f=delay-i;
+    float a=tap(i);
+
+    return a+(tap(i+1)-a)*f;
+}
+
+bool XFMEffects::DelayLine::ringing() const
+{
+    return sinceLoud <= mask;
+}
+
+XFMEffects::XFMEffects(float sampleRate/*=48000*/)
+{
+    unsigned char init[512];
+
+    m_sampleRate=sampleRate;
+
+    m_chorusLine[0].create(static_cast<int>(0.025f*sampleRate));
+    m_chorusLine[1].create(static_cast<int>(0.025f*sampleRate));
+    m_delayLine[0].create(static_cast<int>(2.0f*sampleRate));
+    m_delayLine[1].create(static_cast<int>(2.0f*sampleRate));
+
+    // The reverb is tuned like Freeverb, with the lines sized for the hall
+    static const int combs[4]={ 1116, 1188, 1277, 1356 };
+    static const int allPasses[2]={ 556, 441 };
+
+    for (int s=0; s<2; s++) {
+        for (int c=0; c<4; c++) {
+            m_combSize[s][c]=static_cast<int>((combs[c]+23*s)*sampleRate/44100);
+            m_comb[s][c].create(m_combSize[s][c]);
+        }
+        for (int a=0; a<2; a++) {
+            m_allPassSize[s][a]=static_cast<int>((allPasses[a]+23*s)*sampleRate/44100);
+            m_allPass[s][a].create(m_allPassSize[s][a]);
+        }
+    }
+
+    memset(init, 0, sizeof(init));
+    load(init);
+}
+
+float XFMEffects::coefficient(float hz) const
+{
+    if (hz > 0.45f*m_sampleRate) {
+        return 1;
+    }
+
+    return 1-expf(static_cast<float>(-2*M_PI)*hz/m_sampleRate);
+}
+
+void XFMEffects::load(const unsigned char *image)
+{
+    static const int normal[Stages]={ Decimator, Bitcrusher, Filter, Chorus, Phaser, AM, Delay, Reverb };
+    static const int delayFirst[Stages]={ Decimator, Bitcrusher, Filter, Delay, Chorus, Phaser, AM, Reverb };
+
+    memcpy(m_order, image[FX_ROUTING] == 1 ? delayFirst : normal, sizeof(m_order));
+
+    // Decimator holds each sample for up to 32, and the bit crusher goes
+    // from 16 bits down to 1
+    m_hold=1+image[FX_DECIMATOR_DEPTH]/8;
+    m_crush=exp2f(static_cast<float>(15-image[FX_BITCRUSHER_DEPTH]*15/255));
+    m_enabled[Decimator]=m_hold > 1;
+    m_enabled[Bitcrusher]=image[FX_BITCRUSHER_DEPTH] != 0;
+
+    // Low pass is open at 255, high pass off at 0
+    m_lowPassOn=image[FX_FILTER_LO] != 255;
+    m_highPassOn=image[FX_FILTER_HI] != 0;
+    m_lowPass.a=coefficient(cutoffHz(image[FX_FILTER_LO]));
+    m_highPass.a=coefficient(cutoffHz(image[FX_FILTER_HI]));
+    m_enabled[Filter]=m_lowPassOn || m_highPassOn;
+
+    // Chorus.  Mode bit 0 makes it a flanger, bit 1 inverts the feedback
+    int mode=image[FX_CHORUS_MODE];
+
+    m_chorusDry=image[FX_CHORUS_DRY]/255.0f;
+    m_chorusWet=image[FX_CHORUS_WET]/255.0f;
+    m_chorusFeedback=image[FX_CHORUS_FEEDBACK]/255.0f*0.9f*((mode & 2) ? -1 : 1);
+    m_chorusBase=((mode & 1) ? 0.001f : 0.012f)*m_sampleRate;
+    m_chorusDepth=image[FX_CHORUS_DEPTH]/255.0f*((mode & 1) ? 0.003f : 0.008f)*m_sampleRate;
+    m_chorusRate=lfoHz(image[FX_CHORUS_SPEED])/m_sampleRate;
+    m_chorusSpread=image[FX_CHORUS_LRPHASE]/255.0f;
+    m_enabled[Chorus]=image[FX_CHORUS_WET] != 0;
+
+    // Phaser.  Mode 1 inverts the wet signal, turning notches into peaks,
+    // and mode 2 stops the sweep
+    m_phaserDry=image[FX_PHASER_DRY]/255.0f;
+    m_phaserWet=image[FX_PHASER_WET]/255.0f;
+    m_phaserFeedback=image[FX_PHASER_FEEDBACK]/255.0f*0.9f;
+    m_phaserCentre=100.0f*powf(40.0f, image[FX_PHASER_OFFSET]/255.0f);
+    m_phaserDepth=image[FX_PHASER_DEPTH]/255.0f*4;
+    m_phaserRate=image[FX_PHASER_MODE] == 2 ? 0 : lfoHz(image[FX_PHASER_SPEED])/m_sampleRate;
+    m_phaserSpread=image[FX_PHASER_LRPHASE]/255.0f;
+    m_phaserInvert=image[FX_PHASER_MODE] == 1;
+    m_phaserStages=image[FX_PHASER_STAGES];
+    if (m_phaserStages < 1) m_phaserStages=1;
+    if (m_phaserStages > PhaserStages) m_phaserStages=PhaserStages;
+    m_enabled[Phaser]=image[FX_PHASER_WET] != 0;
+
+    // AM.  Range speeds the LFO up by as much as 17 times, into audio rates
+    m_amDepth=image[FX_AM_DEPTH]/255.0f;
+    m_amRate=lfoHz(image[FX_AM_SPEED])*(1+image[FX_AM_RANGE]/16.0f)/m_sampleRate;
+    m_amSpread=image[FX_AM_LRPHASE]/255.0f;
+    m_enabled[AM]=image[FX_AM_DEPTH] != 0;
+
+    // Delay.  With a tempo set the time is a beat, times MUL and divided by
+    // DIV, otherwise it's 4ms per step of TIME
+    float seconds=image[FX_DELAY_TIME]*0.004f;
+
+    if (image[FX_DELAY_TEMPO] != 0) {
+        int mul=image[FX_DELAY_MUL] ? image[FX_DELAY_MUL] : 1;
+        int div=image[FX_DELAY_DIV] ? image[FX_DELAY_DIV] : 1;
+
+        seconds=60.0f/image[FX_DELAY_TEMPO]*mul/div;
+    }
+
+    m_delayTime=static_cast<int>(seconds*m_sampleRate);
+    if (m_delayTime < 1) m_delayTime=1;
+    if (m_delayTime > m_delayLine[0].mask-1) m_delayTime=m_delayLine[0].mask-1;
+
+    m_delayDry=image[FX_DELAY_DRY]/255.0f;
+    m_delayWet=image[FX_DELAY_WET]/255.0f;
+    m_delayFeedback=image[FX_DELAY_FEEDBACK]/255.0f*0.95f;
+    m_delayMode=image[FX_DELAY_MODE] > 2 ? 2 : image[FX_DELAY_MODE];
+    m_delayLowPass.a=image[FX_DELAY_LO] == 255 ? 1 : coefficient(cutoffHz(image[FX_DELAY_LO]));
+    m_delayHighPass.a=coefficient(cutoffHz(image[FX_DELAY_HI]));
+    m_delayHighPassOn=image[FX_DELAY_HI] != 0;
+    m_enabled[Delay]=image[FX_DELAY_WET] != 0;
+
+    // Reverb.  Mode 0 is a room, using the lines at 60% of their length
+    float scale=image[FX_REVERB_MODE] == 0 ? 0.6f : 1.0f;
+
+    for (int s=0; s<2; s++) {
+        for (int c=0; c<4; c++) {
+            m_combLength[s][c]=static_cast<int>(m_combSize[s][c]*scale);
+        }
+        for (int a=0; a<2; a++) {
+            m_allPassLength[s][a]=static_cast<int>(m_allPassSize[s][a]*scale);
+        }
+    }
+
+    m_reverbDry=image[FX_REVERB_DRY]/255.0f;
+    m_reverbWet=image[FX_REVERB_WET]/255.0f;
+    m_reverbFeedback=0.7f+image[FX_REVERB_DECAY]/255.0f*0.28f;
+    m_reverbDamp=image[FX_REVERB_DAMP]/255.0f*0.4f;
+    m_enabled[Reverb]=image[FX_REVERB_WET] != 0;
+
+    reset();
+}
+
+void XFMEffects::reset()
+{
+    m_held=0;
+    m_heldSample[0]=0;
+    m_heldSample[1]=0;
+
+    memset(m_lowPass.z, 0, sizeof(m_lowPass.z));
+    memset(m_highPass.z, 0, sizeof(m_highPass.z));
+    memset(m_delayLowPass.z, 0, sizeof(m_delayLowPass.z));
+    memset(m_delayHighPass.z, 0, sizeof(m_delayHighPass.z));
+
+    m_chorusPhase=0;
+    m_chorusLast[0]=m_chorusBase+m_chorusDepth*0.5f;
+    m_chorusLast[1]=m_chorusLast[0];
+    m_chorusLine[0].clear();
+    m_chorusLine[1].clear();
+
+    m_phaserPhase=0;
+    memset(m_phaserState, 0, sizeof(m_phaserState));
+    memset(m_phaserOut, 0, sizeof(m_phaserOut));
+    m_phaserCoef[0]=-1;
+    m_phaserCoef[1]=-1;
+
+    m_amPhase=0;
+
+    m_delayLine[0].clear();
+    m_delayLine[1].clear();
+
+    memset(m_combDamp, 0, sizeof(m_combDamp));
+    for (int s=0; s<2; s++) {
+        for (int c=0; c<4; c++) {
+            m_comb[s][c].clear();
+        }
+        m_allPass[s][0].clear();
+        m_allPass[s][1].clear();
+    }
+}
+
+bool XFMEffects::ringing() const
+{
+    for (int s=0; s<2; s++) {
+        if (m_enabled[Chorus] && m_chorusLine[s].ringing()) {
+            return true;
+        }
+        if (m_enabled[Delay] && m_delayLine[s].ringing()) {
+            return true;
+        }
+        for (int c=0; c<4 && m_enabled[Reverb]; c++) {
+            if (m_comb[s][c].ringing()) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void XFMEffects::process(float *left, float *right, int frames)
+{
+    for (int done=0; done<frames; done+=BLOCK) {
+        int n=(frames-done < BLOCK) ? frames-done : BLOCK;
+
+        processBlock(&left[done], &right[done], n);
+    }
+}
+
+void XFMEffects::processBlock(float *left, float *right, int n)
+{
+    for (int i=0; i<Stages; i++) {
+        if (!m_enabled[m_order[i]]) {
+            continue;
+        }
+
+        switch (m_order[i]) {
+            case Decimator:     decimate(left, right, n);   break;
+            case Bitcrusher:    crush(left, right, n);      break;
+            case Filter:        filter(left, right, n);     break;
+            case Chorus:        chorus(left, right, n);     break;
+            case Phaser:        phaser(left, right, n);     break;
+            case AM:            amplitude(left, right, n);  break;
+            case Delay:         delay(left, right, n);      break;
+            case Reverb:        reverb(left, right, n);     break;
+            default:                                        break;
+        }
+    }
+}
+
+void XFMEffects::decimate(float *left, float *right, int n)
+{
+    for (int i=0; i<n; i++) {
+        if (m_held == 0) {
+            m_heldSample[0]=left[i];
+            m_heldSample[1]=right[i];
+        }
+        m_held=(m_held+1 < m_hold) ? m_held+1 : 0;
+
+        left[i]=m_heldSample[0];
+        right[i]=m_heldSample[1];
+    }
+}
+
+void XFMEffects::crush(float *left, float *right, int n)
+{
+    float step=1/m_crush;
+
+    for (int i=0; i<n; i++) {
+        left[i]=floorf(left[i]*m_crush+0.5f)*step;
+        right[i]=floorf(right[i]*m_crush+0.5f)*step;
+    }
+}
+
+// One pole each way.  The high pass is what's left after a low pass
+void XFMEffects::filter(float *left, float *right, int n)
+{
+    float *side[2]={ left, right };
+
+    for (int s=0; s<2; s++) {
+        float *x=side[s];
+        float lp=m_lowPass.z[s];
+        float hp=m_highPass.z[s];
+
+        for (int i=0; i<n; i++) {
+            float v=x[i];
+
+            if (m_lowPassOn) {
+                lp+=m_lowPass.a*(v-lp);
+                v=lp;
+            }
+            if (m_highPassOn) {
+                hp+=m_highPass.a*(v-hp);
+                v-=hp;
+            }
+            x[i]=v;
+        }
+
+        m_lowPass.z[s]=lp;
+        m_highPass.z[s]=hp;
+    }
+}
+
+// A delay line a side, swept by a sine LFO.  The sweep is worked out at
+// the end of each block and ramped from where the last block left it
+void XFMEffects::chorus(float *left, float *right, int n)
+{
+    float *side[2]={ left, right };
+    float phase=wrap(m_chorusPhase+m_chorusRate*n);
+
+    for (int s=0; s<2; s++) {
+        DelayLine &line=m_chorusLine[s];
+        float *x=side[s];
+        float d0=m_chorusLast[s];
+        float d1=m_chorusBase+m_chorusDepth*(0.5f+0.5f*xfmSine(phase+m_chorusSpread*s));
+        float dd=(d1-d0)/n;
+
+        for (int i=0; i<n; i++) {
+            float w=line.read(1+d0+dd*i);
+
+            line.write(x[i]+w*m_chorusFeedback);
+            x[i]=x[i]*m_chorusDry+w*m_chorusWet;
+        }
+
+        m_chorusLast[s]=d1;
+    }
+
+    m_chorusPhase=phase;
+}
+
+// A chain of first order all passes, their corner swept around the centre
+// by the LFO.  Only the coefficient is worked out per block
+void XFMEffects::phaser(float *left, float *right, int n)
+{
+    float *side[2]={ left, right };
+    float phase=wrap(m_phaserPhase+m_phaserRate*n);
+
+    for (int s=0; s<2; s++) {
+        float *x=side[s];
+        float *z=m_phaserState[s];
+        float hz=m_phaserCentre*exp2f(m_phaserDepth*xfmSine(phase+m_phaserSpread*s));
+
+        if (hz > 0.45f*m_sampleRate) hz=0.45f*m_sampleRate;
+
+        float t=tanf(static_cast<float>(M_PI)*hz/m_sampleRate);
+        float a1=(t-1)/(t+1);
+        float a0=(m_phaserCoef[s] <= -1) ? a1 : m_phaserCoef[s];
+        float da=(a1-a0)/n;
+        float out=m_phaserOut[s];
+        float wet=m_phaserInvert ? -m_phaserWet : m_phaserWet;
+
+        for (int i=0; i<n; i++) {
+            float a=a0+da*i;
+            float v=x[i]+out*m_phaserFeedback;
+
+            for (int k=0; k<m_phaserStages; k++) {
+                float y=a*v+z[k];
+
+                z[k]=v-a*y;
+                v=y;
+            }
+
+            out=v;
+            x[i]=x[i]*m_phaserDry+v*wet;
+        }
+
+        m_phaserOut[s]=out;
+        m_phaserCoef[s]=a1;
+    }
+
+    m_phaserPhase=phase;
+}
+
+void XFMEffects::amplitude(float *left, float *right, int n)
+{
+    float *side[2]={ left, right };
+
+    for (int s=0; s<2; s++) {
+        float *x=side[s];
+        float phase=m_amPhase+m_amSpread*s;
+
+        for (int i=0; i<n; i++) {
+            x[i]*=1-m_amDepth*(0.5f-0.5f*xfmSine(phase+m_amRate*i));
+        }
+    }
+
+    m_amPhase=wrap(m_amPhase+m_amRate*n);
+}
+
+/*
+ * The echo goes back into the line through a low and a high pass.  In
+ * mono both sides share the left line, in stereo each has its own, and
+ * ping pong feeds each side's echo into the other
+ */
+void XFMEffects::delay(float *left, float *right, int n)
+{
+    DelayLine &l=m_delayLine[0];
+    DelayLine &r=m_delayLine[1];
+    float *lp=m_delayLowPass.z;
+    float *hp=m_delayHighPass.z;
+    float la=m_delayLowPass.a;
+    float ha=m_delayHighPassOn ? m_delayHighPass.a : 0;
+
+    for (int i=0; i<n; i++) {
+        float wl=l.tap(m_delayTime);
+        float wr=(m_delayMode == 0) ? wl : r.tap(m_delayTime);
+
+        lp[0]+=la*(wl-lp[0]);
+        hp[0]+=ha*(lp[0]-hp[0]);
+        float fl=(lp[0]-hp[0])*m_delayFeedback;
+
+        lp[1]+=la*(wr-lp[1]);
+        hp[1]+=ha*(lp[1]-hp[1]);
+        float fr=(lp[1]-hp[1])*m_delayFeedback;
+
+        switch (m_delayMode) {
+            case 0:
+                l.write((left[i]+right[i])*0.5f+fl);
+                break;
+            case 1:
+                l.write(left[i]+fl);
+                r.write(right[i]+fr);
+                break;
+            default:
+                l.write((left[i]+right[i])*0.5f+fr);
+                r.write(fl);
+                break;
+        }
+
+        left[i]=left[i]*m_delayDry+wl*m_delayWet;
+        right[i]=right[i]*m_delayDry+wr*m_delayWet;
+    }
+}
+
+// Freeverb's layout: damped combs in parallel, then all passes in series
+void XFMEffects::reverb(float *left, float *right, int n)
+{
+    float *side[2]={ left, right };
+
+    for (int i=0; i<n; i++) {
+        float in=(left[i]+right[i])*0.015f;
+
+        for (int s=0; s<2; s++) {
+            float acc=0;
+
+            for (int c=0; c<4; c++) {
+                DelayLine &comb=m_comb[s][c];
+                float y=comb.tap(m_combLength[s][c]);
+
+                m_combDamp[s][c]=y*(1-m_reverbDamp)+m_combDamp[s][c]*m_reverbDamp;
+                comb.write(in+m_combDamp[s][c]*m_reverbFeedback);
+                acc+=y;
+            }
+
+            for (int a=0; a<2; a++) {
+                DelayLine &allPass=m_allPass[s][a];
+                float y=allPass.tap(m_allPassLength[s][a]);
+
+                allPass.write(acc+y*0.5f);
+                acc=y-acc;
+            }
+
+            side[s][i]=side[s][i]*m_reverbDry+acc*m_reverbWet*3;
+        }
+    }
+}
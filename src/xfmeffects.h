@@ -0,0 +1,154 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMEFFECTS_H
+#define XFMEFFECTS_H
+
+#include <vector>
+
+/*
+ * The synth's effects section, for the offline renderer.
+ *
+ * Each effect works on a block of samples in place.  Its controls (LFOs,
+ * sweeps and the like) are worked out once per block and ramped across it,
+ * so only the parts that genuinely depend on the previous sample (filters,
+ * delay lines with feedback) run a sample at a time.  An effect with its
+ * wet level at 0 is skipped altogether; the decimator, bit crusher, filters
+ * and AM have no wet level, and are skipped when they'd make no change.
+ *
+ * The chain runs decimator, bit crusher, filters, chorus, phaser, AM, delay
+ * and reverb.  FX_ROUTING 1 moves the delay ahead of the chorus.
+ *
+ * Delay lines are sized for their longest setting when the effects are
+ * made, so nothing is allocated while processing.
+ */
+class XFMEffects {
+public:
+    explicit XFMEffects(float sampleRate=48000);
+
+    // Take the FX_ settings from a patch image
+    void load(const unsigned char *image);
+
+    // Clear delay lines and filters
+    void reset();
+
+    void process(float *left, float *right, int frames);
+
+    // True while a delay line still holds something audible, so there's a
+    // tail to render after the voices have stopped
+    bool ringing() const;
+
+private:
+    enum Stage { Decimator, Bitcrusher, Filter, Chorus, Phaser, AM, Delay, Reverb, Stages };
+
+    // A power of two ring of samples
+    struct DelayLine {
+        std::vector<float>  buffer;
+        int     mask;
+        int     pos;
+        int     sinceLoud;      // Samples since one above the threshold was written
+
+        void create(int samples);
+        void clear();
+        void write(float v);
+        float tap(int delay) const;         // delay samples back, 1 or more
+        float read(float delay) const;      // Between samples, interpolated
+        bool ringing() const;
+    };
+
+    struct OnePole {
+        float   a;
+        float   z[2];
+    };
+
+    void processBlock(float *left, float *right, int n);
+    void decimate(float *left, float *right, int n);
+    void crush(float *left, float *right, int n);
+    void filter(float *left, float *right, int n);
+    void chorus(float *left, float *right, int n);
+    void phaser(float *left, float *right, int n);
+    void amplitude(float *left, float *right, int n);
+    void delay(float *left, float *right, int n);
+    void reverb(float *left, float *right, int n);
+
+    float coefficient(float hz) const;
+
+    float       m_sampleRate;
+    int         m_order[Stages];
+    bool        m_enabled[Stages];
+
+    // Decimator and bit crusher
+    int         m_hold;                 // Samples each one is held for
+    int         m_held;
+    float       m_heldSample[2];
+    float       m_crush;                // Levels per unit
+
+    // Filters
+    OnePole     m_lowPass;
+    OnePole     m_highPass;
+    bool        m_lowPassOn;
+    bool        m_highPassOn;
+
+    // Chorus
+    DelayLine   m_chorusLine[2];
+    float       m_chorusDry, m_chorusWet, m_chorusFeedback;
+    float       m_chorusBase, m_chorusDepth;        // In samples
+    float       m_chorusRate, m_chorusPhase, m_chorusSpread;    // Cycles per sample, cycles, cycles
+    float       m_chorusLast[2];        // Delay at the end of the last block
+
+    // Phaser
+    enum { PhaserStages=12 };
+    float       m_phaserDry, m_phaserWet, m_phaserFeedback;
+    float       m_phaserCentre, m_phaserDepth;      // Hz, octaves
+    float       m_phaserRate, m_phaserPhase, m_phaserSpread;
+    int         m_phaserStages;
+    bool        m_phaserInvert;
+    float       m_phaserState[2][PhaserStages];
+    float       m_phaserOut[2];
+    float       m_phaserCoef[2];        // All pass coefficient at the end of the last block, -1 before the first
+
+    // AM
+    float       m_amDepth, m_amRate, m_amPhase, m_amSpread;
+
+    // Delay
+    DelayLine   m_delayLine[2];
+    float       m_delayDry, m_delayWet, m_delayFeedback;
+    int         m_delayTime;            // Samples
+    int         m_delayMode;            // 0 mono, 1 stereo, 2 ping pong
+    OnePole     m_delayLowPass;
+    OnePole     m_delayHighPass;
+    bool        m_delayHighPassOn;
+
+    // Reverb, four combs and two all passes a side
+    DelayLine   m_comb[2][4];
+    DelayLine   m_allPass[2][2];
+    int         m_combSize[2][4];       // Hall lengths.  The buffers are rounded up to a power of two
+    int         m_allPassSize[2][2];
+    int         m_combLength[2][4];     // Lengths for the patch's mode
+    int         m_allPassLength[2][2];
+    float       m_combDamp[2][4];
+    float       m_reverbDry, m_reverbWet, m_reverbFeedback, m_reverbDamp;
+};
+
+#endif // XFMEFFECTS_H
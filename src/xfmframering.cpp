@@ -0,0 +1,122 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "xfmframering.h"
+
+XFMFrameRing::XFMFrameRing()
+{
+    m_head=0;
+    m_tail=0;
+}
+
+int XFMFrameRing::pending() const
+{
+    return static_cast<int>(m_head-m_tail);
+}
+
+int XFMFrameRing::space() const
+{
+    return Capacity-pending();
+}
+
+void XFMFrameRing::clear()
+{
+    m_head=0;
+    m_tail=0;
+}
+
+// Parameters below 256 are sent as 's' <offset> <data>.  The upper half of
+// the parameter space needs an escape byte: 's' 0xff <offset-256> <data>
+bool XFMFrameRing::putSetFrame(int offset, unsigned char data)
+{
+    unsigned char bf[4];
+
+    bf[0]='s';
+    if (offset < 256) {
+        bf[1]=static_cast<unsigned char>(offset);
+        bf[2]=data;
+        return put(bf, 3);
+    }
+
+    bf[1]=0xff;
+    bf[2]=static_cast<unsigned char>(offset-256);
+    bf[3]=data;
+    return put(bf, 4);
+}
+
+bool XFMFrameRing::put(const unsigned char *frame, int length)
+{
+    if (length > space()) {
+        return false;
+    }
+
+    for (int i=0; i<length; i++) {
+        m_ring[(m_head+static_cast<unsigned int>(i)) & Mask]=frame[i];
+    }
+    m_head+=static_cast<unsigned int>(length);
+
+    return true;
+}
+
+bool XFMFrameRing::take(XFMFrameRing &from)
+{
+    int n=from.pending();
+
+    if (n > space()) {
+        return false;
+    }
+
+    for (int i=0; i<n; i++) {
+        m_ring[(m_head+static_cast<unsigned int>(i)) & Mask]=from.m_ring[(from.m_tail+static_cast<unsigned int>(i)) & Mask];
+    }
+    m_head+=static_cast<unsigned int>(n);
+    from.m_tail+=static_cast<unsigned int>(n);
+
+    return true;
+}
+
+// The pending bytes may wrap around the end of the ring, so they are
+// copied out in at most two pieces
+int XFMFrameRing::drain(char *out, int max/*=Capacity*/)
+{
+    int n=pending();
+
+    if (n > max) {
+        n=max;
+    }
+    int start=static_cast<int>(m_tail & Mask);
+    int first=n;
+
+    if (start+first > Capacity) {
+        first=Capacity-start;
+    }
+
+    memcpy(out, &m_ring[start], static_cast<size_t>(first));
+    if (first < n) {
+        memcpy(&out[first], &m_ring[0], static_cast<size_t>(n-first));
+    }
+
+    m_tail+=static_cast<unsigned int>(n);
+    return n;
+}
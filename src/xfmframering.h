@@ -0,0 +1,68 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMFRAMERING_H
+#define XFMFRAMERING_H
+
+/*
+ * A fixed size ring of encoded serial frames.
+ * Parameter changes are encoded straight into preallocated storage, and the
+ * transport later drains everything that is pending into a flat buffer so it
+ * can be sent with a single write.  Nothing in here ever touches the heap.
+ */
+
+class XFMFrameRing {
+public:
+    // Capacity must be a power of two.  4K holds over a thousand 4 byte frames,
+    // which is more than a complete patch worth of parameter changes
+    enum { Capacity=4096, Mask=Capacity-1 };
+
+    XFMFrameRing();
+
+    // Encode a parameter set command ('s') into the ring.
+    // Returns false if there isn't enough room, in which case the caller should drain first
+    bool putSetFrame(int offset, unsigned char data);
+
+    // Append raw command bytes to the ring
+    bool put(const unsigned char *frame, int length);
+
+    // Move everything pending in another ring onto the end of this one.
+    // Returns false (and leaves both rings alone) if there isn't enough room
+    bool take(XFMFrameRing &from);
+
+    // Copy up to max pending bytes into out (which must hold at least Capacity bytes)
+    // and remove them from the ring.  Returns the number of bytes copied
+    int drain(char *out, int max=Capacity);
+
+    void clear();
+
+    int pending() const;
+    int space() const;
+
+private:
+    unsigned char   m_ring[Capacity];   // Encoded frames waiting to be sent
+    unsigned int    m_head;             // Write position (free running)
+    unsigned int    m_tail;             // Read position (free running)
+};
+
+#endif // XFMFRAMERING_H
@@ -0,0 +1,187 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "xfmhistory.h"
+
+XFMHistory::XFMHistory()
+{
+    m_current=0;
+    m_open=false;
+    m_lastChange=0;
+
+    for (int i=0; i<BufferSize; i++) {
+        m_where[i]=-1;
+    }
+}
+
+void XFMHistory::record(int offset, unsigned char before, unsigned char after, long long now)
+{
+    if (offset < 0 || offset >= BufferSize) {
+        return;
+    }
+
+    // Anything that was undone can't be redone after a new edit
+    if (m_current < static_cast<int>(m_steps.size())) {
+        closeStep();
+        m_changes.resize(m_steps[m_current]);
+        m_steps.resize(m_current);
+    }
+
+    if (m_open && now-m_lastChange > StepGap) {
+        closeStep();
+    }
+
+    if (!m_open) {
+        m_steps.push_back(static_cast<int>(m_changes.size()));
+        m_current=static_cast<int>(m_steps.size());
+        m_open=true;
+    } else if (m_where[offset] >= 0) {
+        m_changes[m_where[offset]].after=after;
+        m_lastChange=now;
+        return;
+    }
+
+    Change c;
+
+    c.offset=static_cast<unsigned short>(offset);
+    c.before=before;
+    c.after=after;
+    m_where[offset]=static_cast<int>(m_changes.size());
+    m_changes.push_back(c);
+    m_lastChange=now;
+
+    if (static_cast<int>(m_changes.size()) > MaxChanges && m_steps.size() > 1) {
+        dropOldest();
+    }
+}
+
+void XFMHistory::checkpoint()
+{
+    closeStep();
+}
+
+// Only the bytes written in the open step have an entry to forget
+void XFMHistory::closeStep()
+{
+    if (m_open && !m_steps.empty()) {
+        for (size_t i=static_cast<size_t>(m_steps.back()); i<m_changes.size(); i++) {
+            m_where[m_changes[i].offset]=-1;
+        }
+    }
+
+    m_open=false;
+}
+
+bool XFMHistory::undo(unsigned char *buffer)
+{
+    if (!canUndo()) {
+        return false;
+    }
+
+    closeStep();
+    m_current--;
+
+    int first=m_steps[m_current];
+    int last=static_cast<int>(m_changes.size());
+
+    if (m_current+1 < static_cast<int>(m_steps.size())) {
+        last=m_steps[m_current+1];
+    }
+
+    // Backwards, so a byte changed twice ends up with its oldest value
+    for (int i=last-1; i>=first; i--) {
+        buffer[m_changes[i].offset]=m_changes[i].before;
+    }
+
+    return true;
+}
+
+bool XFMHistory::redo(unsigned char *buffer)
+{
+    if (!canRedo()) {
+        return false;
+    }
+
+    int first=m_steps[m_current];
+    int last=static_cast<int>(m_changes.size());
+
+    if (m_current+1 < static_cast<int>(m_steps.size())) {
+        last=m_steps[m_current+1];
+    }
+
+    for (int i=first; i<last; i++) {
+        buffer[m_changes[i].offset]=m_changes[i].after;
+    }
+
+    closeStep();
+    m_current++;
+    return true;
+}
+
+bool XFMHistory::canUndo() const
+{
+    return m_current > 0;
+}
+
+bool XFMHistory::canRedo() const
+{
+    return m_current < static_cast<int>(m_steps.size());
+}
+
+void XFMHistory::clear()
+{
+    closeStep();
+    m_changes.clear();
+    m_steps.clear();
+    m_current=0;
+}
+
+// Forget the oldest steps to keep the journal bounded.  A quarter goes at
+// once so the erase doesn't happen on every edit
+void XFMHistory::dropOldest()
+{
+    int target=MaxChanges/4;
+    int steps=1;
+
+    while (steps < m_current-1 && m_steps[steps] < target) {
+        steps++;
+    }
+
+    int n=m_steps[steps];
+
+    m_changes.erase(m_changes.begin(), m_changes.begin()+n);
+    m_steps.erase(m_steps.begin(), m_steps.begin()+steps);
+    for (size_t i=0; i<m_steps.size(); i++) {
+        m_steps[i]-=n;
+    }
+
+    // The open step is never dropped, but its entries have moved
+    for (int i=0; i<BufferSize; i++) {
+        if (m_where[i] >= 0) {
+            m_where[i]-=n;
+        }
+    }
+
+    m_current-=steps;
+}
@@ -0,0 +1,90 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMHISTORY_H
+#define XFMHISTORY_H
+
+#include <vector>
+
+/*
+ * Undo/redo history for an edit buffer.
+ *
+ * Rather than keeping copies of the buffer, the history is a journal of the
+ * bytes that changed, each with its old and new value.  The journal is split
+ * into steps, and starting a step only records where it begins, so taking a
+ * snapshot costs nothing no matter how big the patch is.  Edits that arrive
+ * close together (a slider being dragged, or an operator update) land in the
+ * same step, and repeated writes to the same byte are folded into one entry,
+ * however many other bytes were written in between.  A step never holds
+ * more than one entry per byte, so even a long drag across an XY pad stays
+ * within the size of the buffer.
+ */
+
+class XFMHistory {
+public:
+    // Writes further apart than this, in milliseconds, start a new step
+    enum { StepGap=500 };
+
+    // Oldest steps are dropped once the journal holds this many changes
+    enum { MaxChanges=65536 };
+
+    // Bytes in the buffer being tracked
+    enum { BufferSize=512 };
+
+    XFMHistory();
+
+    // Note a change to the buffer.  now is a millisecond clock used to group edits into steps
+    void record(int offset, unsigned char before, unsigned char after, long long now);
+
+    // Close the current step, so the next change starts a new one
+    void checkpoint();
+
+    // Apply the inverse of the last step (or the next undone step) to buffer.
+    // Returns false if there's nothing to undo (or redo)
+    bool undo(unsigned char *buffer);
+    bool redo(unsigned char *buffer);
+
+    bool canUndo() const;
+    bool canRedo() const;
+
+    void clear();
+
+private:
+    struct Change {
+        unsigned short  offset;
+        unsigned char   before;
+        unsigned char   after;
+    };
+
+    void dropOldest();
+    void closeStep();
+
+    std::vector<Change> m_changes;      // Every change, oldest first
+    std::vector<int>    m_steps;        // Index into m_changes where each step starts
+    int                 m_current;      // Number of steps that are applied (the rest can be redone)
+    bool                m_open;         // True if the last step can take more changes
+    int                 m_where[BufferSize];    // Index in m_changes of each byte's entry in the open step, or -1
+    long long           m_lastChange;   // When the last change was recorded
+};
+
+#endif // XFMHISTORY_H
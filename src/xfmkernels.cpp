@@ -0,0 +1,465 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xfmkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XFM2_KERNELS_SSE2
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define XFM2_KERNELS_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define XFM2_KERNELS_NEON
+#endif
+
+// Polynomial coefficients for xfmSine
+#define SINE_C1     6.28318531f
+#define SINE_C3     -41.3417022f
+#define SINE_C5     81.6052493f
+#define SINE_C7     -76.7058597f
+#define SINE_C9     42.0586939f
+
+// The reference kernels
+
+static void scalarOscillate(float phase, float inc, float amp, float damp, float *out, int n)
+{
+    for (int i=0; i<n; i++) {
+        out[i]=xfmSine(phase+inc*i)*(amp+damp*i);
+    }
+}
+
+static void scalarModulate(float phase, float inc, const float *mod, float amp, float damp, float *out, int n)
+{
+    for (int i=0; i<n; i++) {
+        out[i]=xfmSine(phase+inc*i+mod[i])*(amp+damp*i);
+    }
+}
+
+static void scalarAccumulate(const float *src, float depth, float *dst, int n)
+{
+    for (int i=0; i<n; i++) {
+        dst[i]+=src[i]*depth;
+    }
+}
+
+static void scalarMix(const float *src, float l, float r, float *left, float *right, int n)
+{
+    for (int i=0; i<n; i++) {
+        left[i]+=src[i]*l;
+        right[i]+=src[i]*r;
+    }
+}
+
+#ifdef XFM2_KERNELS_SSE2
+
+static inline __m128 sse2Sine(__m128 x)
+{
+    const __m128 one=_mm_set1_ps(1.0f);
+    const __m128 half=_mm_set1_ps(0.5f);
+    const __m128 quarter=_mm_set1_ps(0.25f);
+
+    __m128 u=_mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvttps_epi32(x)));
+    u=_mm_add_ps(u, _mm_and_ps(_mm_cmplt_ps(u, _mm_setzero_ps()), one));
+    u=_mm_sub_ps(u, _mm_and_ps(_mm_cmpge_ps(u, half), one));
+
+    __m128 high=_mm_cmpgt_ps(u, quarter);
+    u=_mm_or_ps(_mm_and_ps(high, _mm_sub_ps(half, u)), _mm_andnot_ps(high, u));
+    __m128 low=_mm_cmplt_ps(u, _mm_set1_ps(-0.25f));
+    u=_mm_or_ps(_mm_and_ps(low, _mm_sub_ps(_mm_set1_ps(-0.5f), u)), _mm_andnot_ps(low, u));
+
+    __m128 u2=_mm_mul_ps(u, u);
+    __m128 p=_mm_add_ps(_mm_set1_ps(SINE_C7), _mm_mul_ps(u2, _mm_set1_ps(SINE_C9)));
+    p=_mm_add_ps(_mm_set1_ps(SINE_C5), _mm_mul_ps(u2, p));
+    p=_mm_add_ps(_mm_set1_ps(SINE_C3), _mm_mul_ps(u2, p));
+    p=_mm_add_ps(_mm_set1_ps(SINE_C1), _mm_mul_ps(u2, p));
+
+    return _mm_mul_ps(u, p);
+}
+
+static void sse2Modulate(float phase, float inc, const float *mod, float amp, float damp, float *out, int n)
+{
+    const __m128 lanes=_mm_set_ps(3, 2, 1, 0);
+    const __m128 vinc=_mm_set1_ps(inc);
+    const __m128 vdamp=_mm_set1_ps(damp);
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        __m128 index=_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+        __m128 x=_mm_add_ps(_mm_set1_ps(phase), _mm_mul_ps(vinc, index));
+        __m128 a=_mm_add_ps(_mm_set1_ps(amp), _mm_mul_ps(vdamp, index));
+
+        if (mod != nullptr) {
+            x=_mm_add_ps(x, _mm_loadu_ps(&mod[i]));
+        }
+        _mm_storeu_ps(&out[i], _mm_mul_ps(sse2Sine(x), a));
+    }
+
+    for (; i<n; i++) {
+        out[i]=xfmSine(phase+inc*i+(mod != nullptr ? mod[i] : 0))*(amp+damp*i);
+    }
+}
+
+static void sse2Oscillate(float phase, float inc, float amp, float damp, float *out, int n)
+{
+    sse2Modulate(phase, inc, nullptr, amp, damp, out, n);
+}
+
+static void sse2Accumulate(const float *src, float depth, float *dst, int n)
+{
+    const __m128 d=_mm_set1_ps(depth);
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_mul_ps(_mm_loadu_ps(&src[i]), d)));
+    }
+    for (; i<n; i++) {
+        dst[i]+=src[i]*depth;
+    }
+}
+
+static void sse2Mix(const float *src, float l, float r, float *left, float *right, int n)
+{
+    const __m128 vl=_mm_set1_ps(l);
+    const __m128 vr=_mm_set1_ps(r);
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        __m128 s=_mm_loadu_ps(&src[i]);
+        _mm_storeu_ps(&left[i], _mm_add_ps(_mm_loadu_ps(&left[i]), _mm_mul_ps(s, vl)));
+        _mm_storeu_ps(&right[i], _mm_add_ps(_mm_loadu_ps(&right[i]), _mm_mul_ps(s, vr)));
+    }
+    for (; i<n; i++) {
+        left[i]+=src[i]*l;
+        right[i]+=src[i]*r;
+    }
+}
+
+#endif // XFM2_KERNELS_SSE2
+
+#ifdef XFM2_KERNELS_AVX2
+
+// Built for AVX2 and FMA whatever the rest of the app is built for, and
+// only ever called once the CPU has been checked
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static inline __m256 avx2Sine(__m256 x)
+{
+    const __m256 one=_mm256_set1_ps(1.0f);
+    const __m256 half=_mm256_set1_ps(0.5f);
+
+    __m256 u=_mm256_sub_ps(x, _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+    u=_mm256_add_ps(u, _mm256_and_ps(_mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_LT_OQ), one));
+    u=_mm256_sub_ps(u, _mm256_and_ps(_mm256_cmp_ps(u, half, _CMP_GE_OQ), one));
+    u=_mm256_blendv_ps(u, _mm256_sub_ps(half, u), _mm256_cmp_ps(u, _mm256_set1_ps(0.25f), _CMP_GT_OQ));
+    u=_mm256_blendv_ps(u, _mm256_sub_ps(_mm256_set1_ps(-0.5f), u), _mm256_cmp_ps(u, _mm256_set1_ps(-0.25f), _CMP_LT_OQ));
+
+    __m256 u2=_mm256_mul_ps(u, u);
+    __m256 p=_mm256_fmadd_ps(u2, _mm256_set1_ps(SINE_C9), _mm256_set1_ps(SINE_C7));
+    p=_mm256_fmadd_ps(u2, p, _mm256_set1_ps(SINE_C5));
+    p=_mm256_fmadd_ps(u2, p, _mm256_set1_ps(SINE_C3));
+    p=_mm256_fmadd_ps(u2, p, _mm256_set1_ps(SINE_C1));
+
+    return _mm256_mul_ps(u, p);
+}
+
+AVX2 static void avx2Modulate(float phase, float inc, const float *mod, float amp, float damp, float *out, int n)
+{
+    const __m256 lanes=_mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256 vinc=_mm256_set1_ps(inc);
+    const __m256 vdamp=_mm256_set1_ps(damp);
+    int i=0;
+
+    for (; i+8<=n; i+=8) {
+        __m256 index=_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+        __m256 x=_mm256_fmadd_ps(vinc, index, _mm256_set1_ps(phase));
+        __m256 a=_mm256_fmadd_ps(vdamp, index, _mm256_set1_ps(amp));
+
+        if (mod != nullptr) {
+            x=_mm256_add_ps(x, _mm256_loadu_ps(&mod[i]));
+        }
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(avx2Sine(x), a));
+    }
+
+    for (; i<n; i++) {
+        out[i]=xfmSine(phase+inc*i+(mod != nullptr ? mod[i] : 0))*(amp+damp*i);
+    }
+}
+
+AVX2 static void avx2Oscillate(float phase, float inc, float amp, float damp, float *out, int n)
+{
+    avx2Modulate(phase, inc, nullptr, amp, damp, out, n);
+}
+
+AVX2 static void avx2Accumulate(const float *src, float depth, float *dst, int n)
+{
+    const __m256 d=_mm256_set1_ps(depth);
+    int i=0;
+
+    for (; i+8<=n; i+=8) {
+        _mm256_storeu_ps(&dst[i], _mm256_fmadd_ps(_mm256_loadu_ps(&src[i]), d, _mm256_loadu_ps(&dst[i])));
+    }
+    for (; i<n; i++) {
+        dst[i]+=src[i]*depth;
+    }
+}
+
+AVX2 static void avx2Mix(const float *src, float l, float r, float *left, float *right, int n)
+{
+    const __m256 vl=_mm256_set1_ps(l);
+    const __m256 vr=_mm256_set1_ps(r);
+    int i=0;
+
+    for (; i+8<=n; i+=8) {
+        __m256 s=_mm256_loadu_ps(&src[i]);
+        _mm256_storeu_ps(&left[i], _mm256_fmadd_ps(s, vl, _mm256_loadu_ps(&left[i])));
+        _mm256_storeu_ps(&right[i], _mm256_fmadd_ps(s, vr, _mm256_loadu_ps(&right[i])));
+    }
+    for (; i<n; i++) {
+        left[i]+=src[i]*l;
+        right[i]+=src[i]*r;
+    }
+}
+
+#endif // XFM2_KERNELS_AVX2
+
+#ifdef XFM2_KERNELS_NEON
+
+static inline float32x4_t neonSine(float32x4_t x)
+{
+    const float32x4_t one=vdupq_n_f32(1.0f);
+    const float32x4_t half=vdupq_n_f32(0.5f);
+
+    float32x4_t u=vsubq_f32(x, vcvtq_f32_s32(vcvtq_s32_f32(x)));
+    u=vbslq_f32(vcltq_f32(u, vdupq_n_f32(0)), vaddq_f32(u, one), u);
+    u=vbslq_f32(vcgeq_f32(u, half), vsubq_f32(u, one), u);
+    u=vbslq_f32(vcgtq_f32(u, vdupq_n_f32(0.25f)), vsubq_f32(half, u), u);
+    u=vbslq_f32(vcltq_f32(u, vdupq_n_f32(-0.25f)), vsubq_f32(vdupq_n_f32(-0.5f), u), u);
+
+    float32x4_t u2=vmulq_f32(u, u);
+    float32x4_t p=vmlaq_f32(vdupq_n_f32(SINE_C7), u2, vdupq_n_f32(SINE_C9));
+    p=vmlaq_f32(vdupq_n_f32(SINE_C5), u2, p);
+    p=vmlaq_f32(vdupq_n_f32(SINE_C3), u2, p);
+    p=vmlaq_f32(vdupq_n_f32(SINE_C1), u2, p);
+
+    return vmulq_f32(u, p);
+}
+
+static void neonModulate(float phase, float inc, const float *mod, float amp, float damp, float *out, int n)
+{
+    const float lanes[4]={ 0, 1, 2, 3 };
+    const float32x4_t vlanes=vld1q_f32(lanes);
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        float32x4_t index=vaddq_f32(vdupq_n_f32(static_cast<float>(i)), vlanes);
+        float32x4_t x=vmlaq_f32(vdupq_n_f32(phase), index, vdupq_n_f32(inc));
+        float32x4_t a=vmlaq_f32(vdupq_n_f32(amp), index, vdupq_n_f32(damp));
+
+        if (mod != nullptr) {
+            x=vaddq_f32(x, vld1q_f32(&mod[i]));
+        }
+        vst1q_f32(&out[i], vmulq_f32(neonSine(x), a));
+    }
+
+    for (; i<n; i++) {
+        out[i]=xfmSine(phase+inc*i+(mod != nullptr ? mod[i] : 0))*(amp+damp*i);
+    }
+}
+
+static void neonOscillate(float phase, float inc, float amp, float damp, float *out, int n)
+{
+    neonModulate(phase, inc, nullptr, amp, damp, out, n);
+}
+
+static void neonAccumulate(const float *src, float depth, float *dst, int n)
+{
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        vst1q_f32(&dst[i], vmlaq_n_f32(vld1q_f32(&dst[i]), vld1q_f32(&src[i]), depth));
+    }
+    for (; i<n; i++) {
+        dst[i]+=src[i]*depth;
+    }
+}
+
+static void neonMix(const float *src, float l, float r, float *left, float *right, int n)
+{
+    int i=0;
+
+    for (; i+4<=n; i+=4) {
+        float32x4_t s=vld1q_f32(&src[i]);
+        vst1q_f32(&left[i], vmlaq_n_f32(vld1q_f32(&left[i]), s, l));
+        vst1q_f32(&right[i], vmlaq_n_f32(vld1q_f32(&right[i]), s, r));
+    }
+    for (; i<n; i++) {
+        left[i]+=src[i]*l;
+        right[i]+=src[i]*r;
+    }
+}
+
+#endif // XFM2_KERNELS_NEON
+
+static const XFMKernels s_reference={ "scalar", scalarOscillate, scalarModulate, scalarAccumulate, scalarMix };
+
+const XFMKernels &XFMKernels::reference()
+{
+    return s_reference;
+}
+
+// Every set the CPU can run, fastest first
+static const XFMKernels *findKernels()
+{
+    static XFMKernels sets[5];
+    int n=0;
+
+#ifdef XFM2_KERNELS_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        XFMKernels avx2={ "avx2", avx2Oscillate, avx2Modulate, avx2Accumulate, avx2Mix };
+        sets[n++]=avx2;
+    }
+#endif
+#ifdef XFM2_KERNELS_SSE2
+    XFMKernels sse2={ "sse2", sse2Oscillate, sse2Modulate, sse2Accumulate, sse2Mix };
+    sets[n++]=sse2;
+#endif
+#ifdef XFM2_KERNELS_NEON
+    XFMKernels neon={ "neon", neonOscillate, neonModulate, neonAccumulate, neonMix };
+    sets[n++]=neon;
+#endif
+    sets[n++]=s_reference;
+    sets[n].name=nullptr;
+
+    return sets;
+}
+
+/*
+ * The fastest set, or the one XFM2_KERNELS names.  Before it's used it's
+ * checked against the scalar reference, and if it disagrees by more than
+ * the sine approximation could account for the next set down is tried, so
+ * a broken SIMD path costs speed rather than a wrong sound
+ */
+static const XFMKernels *chooseKernels()
+{
+    const float tolerance=1e-4f;
+    const XFMKernels *sets=XFMKernels::available();
+    const char *wanted=getenv("XFM2_KERNELS");
+    int chosen=0;
+
+    if (wanted != nullptr) {
+        for (int i=0; sets[i].name != nullptr; i++) {
+            if (strcmp(sets[i].name, wanted) == 0) {
+                chosen=i;
+                break;
+            }
+        }
+    }
+
+    // The reference is always last, and always agrees with itself
+    while (sets[chosen+1].name != nullptr) {
+        float worst=XFMKernels::verify(sets[chosen]);
+
+        if (worst <= tolerance) {
+            break;
+        }
+
+        fprintf(stderr, "%s kernels are off by %g, not using them\n", sets[chosen].name, static_cast<double>(worst));
+        chosen++;
+    }
+
+    return &sets[chosen];
+}
+
+// Both are worked out once, the first time they're needed, from whichever thread gets there first
+const XFMKernels *XFMKernels::available()
+{
+    static const XFMKernels *sets=findKernels();
+    return sets;
+}
+
+const XFMKernels &XFMKernels::best()
+{
+    static const XFMKernels *chosen=chooseKernels();
+    return *chosen;
+}
+
+// Run both sets over the same awkwardly sized block, with phases and
+// modulation well outside 0-1
+float XFMKernels::verify(const XFMKernels &kernels)
+{
+    const int n=61;
+    float mod[n];
+    float a[n];
+    float b[n];
+    float l[2][n];
+    float r[2][n];
+    float worst=0;
+
+    for (int i=0; i<n; i++) {
+        mod[i]=3.0f*sinf(i*0.37f)-1.2f;
+    }
+
+    for (int pass=0; pass<4; pass++) {
+        float phase=pass*0.7f-1.3f;
+        float inc=0.013f*(pass+1);
+
+        if (pass & 1) {
+            reference().modulate(phase, inc, mod, 0.9f, -0.01f, a, n);
+            kernels.modulate(phase, inc, mod, 0.9f, -0.01f, b, n);
+        } else {
+            reference().oscillate(phase, inc, 0.5f, 0.005f, a, n);
+            kernels.oscillate(phase, inc, 0.5f, 0.005f, b, n);
+        }
+
+        for (int i=0; i<n; i++) {
+            worst=fmaxf(worst, fabsf(a[i]-b[i]));
+        }
+    }
+
+    memcpy(a, mod, sizeof(a));
+    memcpy(b, mod, sizeof(b));
+    reference().accumulate(mod, 0.3f, a, n);
+    kernels.accumulate(mod, 0.3f, b, n);
+
+    memset(l, 0, sizeof(l));
+    memset(r, 0, sizeof(r));
+    reference().mix(mod, 0.25f, 0.75f, l[0], r[0], n);
+    kernels.mix(mod, 0.25f, 0.75f, l[1], r[1], n);
+
+    for (int i=0; i<n; i++) {
+        worst=fmaxf(worst, fabsf(a[i]-b[i]));
+        worst=fmaxf(worst, fabsf(l[0][i]-l[1][i]));
+        worst=fmaxf(worst, fabsf(r[0][i]-r[1][i]));
+    }
+
+    return worst;
+}
@@ -0,0 +1,84 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMKERNELS_H
+#define XFMKERNELS_H
+
+/*
+ * The renderer's inner loops, each working on a block of samples.
+ *
+ * There's a plain C++ version of every kernel, kept as the reference the
+ * others are checked against, plus SSE2 and AVX2 versions on x86 and a NEON
+ * version on ARM.  The best set the CPU supports is picked the first time
+ * it's asked for; setting XFM2_KERNELS to scalar, sse2, avx2 or neon forces
+ * a particular set (if the CPU can run it).
+ *
+ * Oscillator phases are in cycles.  The envelope is applied as a linear
+ * ramp from amp at the first sample, changing by damp each sample.
+ */
+struct XFMKernels {
+    const char *name;
+
+    // out[i]=sin(phase+inc*i)*(amp+damp*i)
+    void (*oscillate)(float phase, float inc, float amp, float damp, float *out, int n);
+
+    // out[i]=sin(phase+inc*i+mod[i])*(amp+damp*i)
+    void (*modulate)(float phase, float inc, const float *mod, float amp, float damp, float *out, int n);
+
+    // dst[i]+=src[i]*depth
+    void (*accumulate)(const float *src, float depth, float *dst, int n);
+
+    // left[i]+=src[i]*l, right[i]+=src[i]*r
+    void (*mix)(const float *src, float l, float r, float *left, float *right, int n);
+
+    // The fastest set this CPU can run that agrees with the reference set,
+    // and the reference set
+    static const XFMKernels &best();
+    static const XFMKernels &reference();
+
+    // Every set this CPU can run, ending with a null name
+    static const XFMKernels *available();
+
+    // Compare a set against the reference.  Returns the largest difference
+    static float verify(const XFMKernels &kernels);
+};
+
+/*
+ * sin(2*pi*x) for x in cycles.  The phase is folded into a quarter cycle
+ * and run through an odd polynomial (good to about 4e-6), without branches
+ * so loops over it vectorise.  The SIMD kernels do the same steps.
+ */
+static inline float xfmSine(float x)
+{
+    float u=x-static_cast<float>(static_cast<int>(x));
+    u+=(u < 0) ? 1.0f : 0.0f;
+    u-=(u >= 0.5f) ? 1.0f : 0.0f;                   // -0.5 to 0.5
+    u=(u > 0.25f) ? 0.5f-u : u;
+    u=(u < -0.25f) ? -0.5f-u : u;                   // -0.25 to 0.25
+
+    const float u2=u*u;
+    return u*(6.28318531f+u2*(-41.3417022f+u2*(81.6052493f+u2*(-76.7058597f+u2*42.0586939f))));
+}
+
+#endif // XFMKERNELS_H
@@ -0,0 +1,302 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+#include "xfmmacro.h"
+#include "xfmdevice.h"
+#include "xfm2.h"
+
+XFMMacros::XFMMacros(XFMDevice *device, QObject *parent) : QObject(parent)
+{
+    m_device=device;
+    m_nextId=1;
+    m_applying=false;
+}
+
+int XFMMacros::add(int unit)
+{
+    if (unit < 0 || unit >= XFM2_UNITS) {
+        return -1;
+    }
+
+    XFMMacro m;
+
+    m.id=m_nextId++;
+    m.unit=unit;
+    m.value=0;
+    m.cc=-1;
+    m.source=-1;
+    m.compiled=false;
+    memset(m.controls, 0, sizeof(m.controls));
+
+    m_macros.push_back(m);
+    return m.id;
+}
+
+bool XFMMacros::remove(int id)
+{
+    for (size_t i=0; i<m_macros.size(); i++) {
+        if (m_macros[i].id == id) {
+            m_macros.erase(m_macros.begin()+static_cast<long>(i));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void XFMMacros::clear()
+{
+    m_macros.clear();
+}
+
+XFMMacro *XFMMacros::find(int id)
+{
+    for (size_t i=0; i<m_macros.size(); i++) {
+        if (m_macros[i].id == id) {
+            return &m_macros[i];
+        }
+    }
+
+    return nullptr;
+}
+
+int XFMMacros::count() const
+{
+    return static_cast<int>(m_macros.size());
+}
+
+bool XFMMacros::addTarget(int id, int offset, int from, int to, XFMCurve::Shape curve)
+{
+    XFMMacro *m=find(id);
+
+    if (m == nullptr || offset < 0 || offset > PerformanceControl4) {
+        return false;
+    }
+
+    XFMMacroTarget t;
+
+    t.offset=offset;
+    if (from < 0) from=0;
+    if (from > 255) from=255;
+    if (to < 0) to=0;
+    if (to > 255) to=255;
+
+    t.from=from;
+    t.to=to;
+    t.curve=curve;
+
+    m->targets.push_back(t);
+    m->compiled=false;
+    return true;
+}
+
+bool XFMMacros::clearTargets(int id)
+{
+    XFMMacro *m=find(id);
+
+    if (m == nullptr) {
+        return false;
+    }
+
+    m->targets.clear();
+    m->compiled=false;
+    return true;
+}
+
+bool XFMMacros::bindControlChange(int id, int cc)
+{
+    XFMMacro *m=find(id);
+
+    if (m == nullptr || cc > 127) {
+        return false;
+    }
+
+    m->cc=cc < 0 ? -1 : cc;
+    return true;
+}
+
+bool XFMMacros::bindPerformanceControl(int id, int control)
+{
+    XFMMacro *m=find(id);
+
+    if (m == nullptr || control > 3) {
+        return false;
+    }
+
+    m->source=control < 0 ? -1 : control;
+    return true;
+}
+
+bool XFMMacros::set(int id, int value)
+{
+    XFMMacro *m=find(id);
+
+    if (m == nullptr) {
+        return false;
+    }
+
+    if (value < 0) value=0;
+    if (value > Positions-1) value=Positions-1;
+
+    apply(*m, value);
+    return true;
+}
+
+int XFMMacros::controlChange(int cc, int value)
+{
+    if (value < 0) value=0;
+    if (value > 127) value=127;
+
+    // Stretch 0-127 over 0-255 so both ends are reachable
+    int position=(value << 1) | (value >> 6);
+
+    int moved=0;
+
+    for (size_t i=0; i<m_macros.size(); i++) {
+        if (m_macros[i].cc == cc) {
+            apply(m_macros[i], position);
+            moved++;
+        }
+    }
+
+    return moved;
+}
+
+void XFMMacros::follow(int unit, int offset, unsigned char value)
+{
+    // A macro's own edits don't feed back into it
+    if (m_applying) {
+        return;
+    }
+
+    for (size_t i=0; i<m_macros.size(); i++) {
+        XFMMacro &m=m_macros[i];
+
+        if (m.unit == unit && m.source >= 0 && resolve(unit, PerformanceControl1+m.source) == offset) {
+            apply(m, value);
+        }
+    }
+}
+
+// Turn a target into a parameter offset.  A performance control gives the
+// parameter it's assigned to, or -1 if it's unassigned (0) or out of range
+int XFMMacros::resolve(int unit, int offset) const
+{
+    if (offset < PerformanceControl1) {
+        return offset;
+    }
+
+    const unsigned char *buffer=m_device->unit(unit).buffer;
+    int control=offset-PerformanceControl1;
+    int p=(buffer[PERFORMANCE_CTRL1_HI+control*2] << 8) | buffer[PERFORMANCE_CTRL1_LO+control*2];
+
+    return (p > 0 && p < 512) ? p : -1;
+}
+
+// Work out every target's value at every position.  Targets that resolve
+// to the same parameter share a column and the last one added wins
+void XFMMacros::compile(XFMMacro &m)
+{
+    const unsigned char *buffer=m_device->unit(m.unit).buffer;
+    std::vector<int> column(m.targets.size());
+
+    memcpy(m.controls, &buffer[PERFORMANCE_CTRL1_HI], sizeof(m.controls));
+    m.offsets.clear();
+
+    for (size_t t=0; t<m.targets.size(); t++) {
+        int offset=resolve(m.unit, m.targets[t].offset);
+
+        column[t]=-1;
+        if (offset < 0) {
+            continue;
+        }
+
+        for (size_t c=0; c<m.offsets.size(); c++) {
+            if (m.offsets[c] == offset) {
+                column[t]=static_cast<int>(c);
+            }
+        }
+
+        if (column[t] < 0) {
+            column[t]=static_cast<int>(m.offsets.size());
+            m.offsets.push_back(static_cast<unsigned short>(offset));
+        }
+    }
+
+    size_t n=m.offsets.size();
+
+    m.table.assign(Positions*n, 0);
+
+    for (size_t t=0; t<m.targets.size(); t++) {
+        const XFMMacroTarget &target=m.targets[t];
+
+        if (column[t] < 0) {
+            continue;
+        }
+
+        for (int p=0; p<Positions; p++) {
+            double y=XFMCurve::apply(target.curve, p/static_cast<double>(Positions-1));
+            long v=lround(target.from+(target.to-target.from)*y);
+            m.table[p*n+static_cast<size_t>(column[t])]=static_cast<unsigned char>(v);
+        }
+    }
+
+    m.compiled=true;
+}
+
+void XFMMacros::apply(XFMMacro &m, int value)
+{
+    const unsigned char *buffer=m_device->unit(m.unit).buffer;
+
+    // Reassigning a performance control moves the targets that go through it
+    if (!m.compiled || memcmp(m.controls, &buffer[PERFORMANCE_CTRL1_HI], sizeof(m.controls)) != 0) {
+        compile(m);
+    }
+
+    m.value=value;
+
+    size_t n=m.offsets.size();
+    const unsigned char *row=n > 0 ? &m.table[static_cast<size_t>(value)*n] : nullptr;
+    XFMTransport *transport=m_device->transport();
+    int changed=0;
+
+    m_applying=true;
+    transport->hold();
+
+    for (size_t i=0; i<n; i++) {
+        if (buffer[m.offsets[i]] != row[i]) {
+            m_device->writeLocation(m.unit, m.offsets[i], row[i]);
+            changed++;
+        }
+    }
+
+    transport->release();
+    m_applying=false;
+
+    if (changed > 0) {
+        emit moved(m.unit);
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMMACRO_H
+#define XFMMACRO_H
+
+#include <QObject>
+#include <vector>
+#include "xfmcurve.h"
+
+class XFMDevice;
+
+/*
+ * One parameter driven by a macro.  As the macro goes from 0 to 255 the
+ * parameter goes from 'from' to 'to' along the curve, so a narrow range
+ * gives the target a light weighting and a reversed one makes it move
+ * against the others.
+ */
+struct XFMMacroTarget {
+    int             offset;         // Parameter, or one of XFMMacros::PerformanceControl1-4
+    int             from;           // Value with the macro at 0
+    int             to;             // Value with the macro at 255
+    XFMCurve::Shape curve;
+};
+
+struct XFMMacro {
+    int                         id;
+    int                         unit;
+    int                         value;          // Current position, 0-255
+    int                         cc;             // MIDI CC that drives the macro, or -1
+    int                         source;         // Performance control (0-3) that drives the macro, or -1
+    std::vector<XFMMacroTarget> targets;
+
+    // Compiled form.  One row of values per position, one column per offset
+    std::vector<unsigned short> offsets;
+    std::vector<unsigned char>  table;
+    unsigned char               controls[8];    // PERFORMANCE_CTRL bytes the offsets were resolved with
+    bool                        compiled;
+};
+
+/*
+ * Macros: one knob (or MIDI CC) driving any number of parameters at once.
+ *
+ * Each macro is compiled into a flat table holding the value of every target
+ * at each of the 256 positions, so moving a macro is a single pass along one
+ * row of the table.  Values that haven't changed are skipped by the device
+ * and the rest go out together in one write.  Edits made by a macro are
+ * ordinary edits, so they can be undone and are picked up by automation.
+ *
+ * The synth's four performance controls can take part either way round.
+ * A target of PerformanceControl1-4 drives whichever parameter the
+ * control is assigned to in the patch (PERFORMANCE_CTRLn_HI/LO).  A macro
+ * with a performance control as its source follows that same parameter,
+ * so editing it from its page moves the macro too.
+ */
+class XFMMacros : public QObject {
+    Q_OBJECT
+
+public:
+    enum {
+        PerformanceControl1=512,
+        PerformanceControl2,
+        PerformanceControl3,
+        PerformanceControl4,
+        Positions=256
+    };
+
+    explicit XFMMacros(XFMDevice *device, QObject *parent = nullptr);
+
+    // Add a macro to a unit.  Returns its id, or -1 if the unit is out of range
+    int add(int unit);
+    bool remove(int id);
+    void clear();
+
+    XFMMacro *find(int id);
+    int count() const;
+
+    bool addTarget(int id, int offset, int from, int to, XFMCurve::Shape curve);
+    bool clearTargets(int id);
+
+    // Drive a macro from a MIDI CC, or from a performance control (0-3).  -1 unbinds
+    bool bindControlChange(int id, int cc);
+    bool bindPerformanceControl(int id, int control);
+
+    // Move a macro to a position from 0 to 255
+    bool set(int id, int value);
+
+    // A MIDI control change (values 0-127).  Returns the number of macros it moved
+    int controlChange(int cc, int value);
+
+    // A parameter was edited, so move any macro that follows it
+    void follow(int unit, int offset, unsigned char value);
+
+signals:
+    // A macro changed the edit buffer of the unit
+    void moved(int unit);
+
+private:
+    int resolve(int unit, int offset) const;
+    void compile(XFMMacro &m);
+    void apply(XFMMacro &m, int value);
+
+    XFMDevice *             m_device;
+    std::vector<XFMMacro>   m_macros;
+    int                     m_nextId;
+    bool                    m_applying;     // True while a macro is writing its targets
+};
+
+#endif // XFMMACRO_H
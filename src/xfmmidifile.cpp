@@ -0,0 +1,263 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "xfmmidifile.h"
+
+static unsigned long bigEndian(const unsigned char *p, int bytes)
+{
+    unsigned long v=0;
+
+    for (int i=0; i<bytes; i++) {
+        v=(v << 8) | p[i];
+    }
+
+    return v;
+}
+
+// A variable length number: 7 bits a byte, top bit set on all but the last
+static bool readNumber(const unsigned char *data, size_t size, size_t &pos, unsigned long &value)
+{
+    value=0;
+
+    for (int i=0; i<4; i++) {
+        if (pos >= size) {
+            return false;
+        }
+
+        unsigned char b=data[pos++];
+
+        value=(value << 7) | (b & 0x7f);
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+XFMMidiFile::XFMMidiFile()
+{
+    m_length=0;
+}
+
+bool XFMMidiFile::load(const std::string &filename)
+{
+    FILE *fp;
+
+    fp=fopen(filename.c_str(), "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    std::vector<unsigned char> data;
+    unsigned char buffer[4096];
+    size_t n;
+
+    while ((n=fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data.insert(data.end(), buffer, buffer+n);
+    }
+    fclose(fp);
+
+    return !data.empty() && parse(&data[0], data.size());
+}
+
+bool XFMMidiFile::parse(const unsigned char *data, size_t size)
+{
+    m_events.clear();
+    m_length=0;
+
+    if (size < 14 || memcmp(data, "MThd", 4) != 0) {
+        return false;
+    }
+
+    unsigned long header=bigEndian(&data[4], 4);
+    unsigned long format=bigEndian(&data[8], 2);
+    unsigned long division=bigEndian(&data[12], 2);
+
+    // Format 2 files are separate songs, which we can't play as one
+    if (header < 6 || header > size-8 || format > 1 || division == 0) {
+        return false;
+    }
+
+    std::vector<Timed> timed;
+    size_t pos=8+header;
+
+    // Chunks other than tracks are skipped
+    while (size-pos >= 8) {
+        unsigned long length=bigEndian(&data[pos+4], 4);
+        size_t available=size-pos-8;
+
+        if (memcmp(&data[pos], "MTrk", 4) == 0) {
+            readTrack(&data[pos+8], length < available ? length : available, timed);
+        }
+        if (length >= available) {
+            break;
+        }
+        pos+=8+length;
+    }
+
+    std::sort(timed.begin(), timed.end(), [](const Timed &a, const Timed &b) {
+        return a.tick != b.tick ? a.tick < b.tick : a.order < b.order;
+    });
+
+    // Ticks are a fraction of a quarter note, 120 bpm until the tempo is
+    // set, or with SMPTE timing a fraction of a frame
+    bool smpte=(division & 0x8000) != 0;
+    double perTick;
+
+    if (smpte) {
+        unsigned long fps=256-(division >> 8);
+        unsigned long perFrame=division & 0xff;
+
+        if (perFrame == 0) {
+            return false;
+        }
+        perTick=1.0/(fps*perFrame);
+    } else {
+        perTick=0.5/division;
+    }
+
+    double seconds=0;
+    unsigned long tick=0;
+
+    for (size_t i=0; i<timed.size(); i++) {
+        seconds+=(timed[i].tick-tick)*perTick;
+        tick=timed[i].tick;
+
+        if (timed[i].tempo != 0) {
+            if (!smpte) {
+                perTick=timed[i].tempo/1000000.0/division;
+            }
+        } else if (timed[i].event.status != 0) {
+            m_events.push_back(timed[i].event);
+            m_events.back().seconds=seconds;
+        }
+    }
+    m_length=seconds;
+
+    return true;
+}
+
+const std::vector<XFMMidiEvent> &XFMMidiFile::events() const
+{
+    return m_events;
+}
+
+double XFMMidiFile::length() const
+{
+    return m_length;
+}
+
+/*
+ * Add a track's events with their tick from the start of the song.  Tempo
+ * changes and the end of the track go in too, with no status, so the
+ * times and length can be worked out once the tracks are merged.  A
+ * broken track keeps the events read before the damage
+ */
+void XFMMidiFile::readTrack(const unsigned char *data, size_t size, std::vector<Timed> &timed)
+{
+    size_t pos=0;
+    unsigned long tick=0;
+    unsigned char running=0;
+
+    while (pos < size) {
+        unsigned long delta;
+        unsigned long length;
+        Timed t;
+
+        if (!readNumber(data, size, pos, delta) || pos >= size) {
+            return;
+        }
+        tick+=delta;
+
+        t.tick=tick;
+        t.order=timed.size();
+        t.tempo=0;
+        memset(&t.event, 0, sizeof(t.event));
+
+        unsigned char status=data[pos];
+
+        if (status == 0xff) {
+            if (size-pos < 2) {
+                return;
+            }
+
+            unsigned char type=data[pos+1];
+
+            pos+=2;
+            if (!readNumber(data, size, pos, length) || length > size-pos) {
+                return;
+            }
+
+            if (type == 0x51 && length == 3) {
+                t.tempo=bigEndian(&data[pos], 3);
+                if (t.tempo != 0) {
+                    timed.push_back(t);
+                }
+            } else if (type == 0x2f) {
+                timed.push_back(t);
+                return;
+            }
+
+            pos+=length;
+            continue;
+        }
+
+        if (status == 0xf0 || status == 0xf7) {
+            pos++;
+            if (!readNumber(data, size, pos, length) || length > size-pos) {
+                return;
+            }
+            pos+=length;
+            continue;
+        }
+
+        // Running status: the last status carries on until another arrives
+        if (status & 0x80) {
+            if (status > 0xef) {
+                return;
+            }
+            running=status;
+            pos++;
+        } else if (running == 0) {
+            return;
+        }
+
+        size_t bytes=((running & 0xf0) == 0xc0 || (running & 0xf0) == 0xd0) ? 1 : 2;
+
+        if (size-pos < bytes) {
+            return;
+        }
+
+        t.event.status=running;
+        t.event.data1=data[pos] & 0x7f;
+        t.event.data2=(bytes == 2) ? (data[pos+1] & 0x7f) : 0;
+        pos+=bytes;
+
+        timed.push_back(t);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef XFMMIDIFILE_H
+#define XFMMIDIFILE_H
+
+#include <string>
+#include <vector>
+
+// A channel message from a MIDI file, at its time from the start of the song
+struct XFMMidiEvent {
+    double          seconds;
+    unsigned char   status;
+    unsigned char   data1;
+    unsigned char   data2;
+};
+
+/*
+ * A standard MIDI file (format 0 or 1) read into a single list of channel
+ * messages in the order they play.  Tracks are merged and tempo changes
+ * applied as the file is read, so whoever plays it back only needs to
+ * look at the times.  Meta events and SysEx are dropped.
+ */
+class XFMMidiFile {
+public:
+    XFMMidiFile();
+
+    bool load(const std::string &filename);
+    bool parse(const unsigned char *data, size_t size);
+
+    const std::vector<XFMMidiEvent> &events() const;
+
+    // When the last event happens, including the end of track marker
+    double length() const;
+
+private:
+    struct Timed {
+        unsigned long   tick;
+        size_t          order;      // Keeps events at the same tick in file order
+        unsigned long   tempo;      // Microseconds per quarter note, 0 if it's not a tempo change
+        XFMMidiEvent    event;
+    };
+
+    void readTrack(const unsigned char *data, size_t size, std::vector<Timed> &timed);
+
+    std::vector<XFMMidiEvent>   m_events;
+    double                      m_length;
+};
+
+#endif // XFMMIDIFILE_H
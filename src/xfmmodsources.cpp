@@ -0,0 +1,192 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include "xfmmodsources.h"
+#include "xfmkernels.h"
+#include "xfm2.h"
+
+float xfmRateToSeconds(int raw)
+{
+    return 0.001f*powf(20000.0f, raw/255.0f);
+}
+
+void XFMModulationParams::decode(const unsigned char *image)
+{
+    static const int pitchLFOs[4]={ MOD_PITCH_LFO_WHEEL, MOD_PITCH_LFO_AFTER, MOD_PITCH_LFO_BREATH, MOD_PITCH_LFO_FOOT };
+    static const int ampLFOs[4]={ MOD_AMP_LFO_WHEEL, MOD_AMP_LFO_AFTER, MOD_AMP_LFO_BREATH, MOD_AMP_LFO_FOOT };
+    static const int biases[4]={ MOD_EG_BIAS_WHEEL, MOD_EG_BIAS_AFTER, MOD_EG_BIAS_BREATH, MOD_EG_BIAS_FOOT };
+    static const int levels[6]={ PITCH_EG_L0, PITCH_EG_L1, PITCH_EG_L2, PITCH_EG_L3, PITCH_EG_L4, PITCH_EG_L5 };
+    static const int rates[6]={ PITCH_EG_DELAY, PITCH_EG_R1, PITCH_EG_R2, PITCH_EG_R3, PITCH_EG_R4, PITCH_EG_R5 };
+
+    // LFO speed runs from 0.05 Hz to 50 Hz
+    lfoWave=image[LFO_WAVE] > 5 ? 5 : image[LFO_WAVE];
+    lfoSync=image[LFO_SYNC] & 3;
+    lfoHz=0.05f*powf(1000.0f, image[LFO_SPEED]/255.0f);
+    lfoFade=image[LFO_FADE] == 0 ? 0 : xfmRateToSeconds(image[LFO_FADE]);
+    lfoPitch=image[LFO_DEPTH_PITCH]/255.0f;
+    lfoAmp=image[LFO_DEPTH_AMP]/255.0f;
+
+    lfo=lfoPitch > 0 || lfoAmp > 0;
+    for (int c=0; c<4; c++) {
+        pitchLFO[c]=image[pitchLFOs[c]]/255.0f;
+        ampLFO[c]=image[ampLFOs[c]]/255.0f;
+        bias[c]=image[biases[c]]/255.0f;
+        lfo=lfo || pitchLFO[c] > 0 || ampLFO[c] > 0;
+    }
+
+    // Direct pitch bends up to an octave
+    pitch[0]=0;
+    pitch[1]=image[MOD_PITCH_AFTER]/255.0f*12;
+    pitch[2]=image[MOD_PITCH_BREATH]/255.0f*12;
+    pitch[3]=image[MOD_PITCH_FOOT]/255.0f*12;
+
+    // Random detunes up to a quarter tone
+    randomPitch=image[MOD_PITCH_RANDOM]/255.0f*0.5f;
+    bendUp=image[MASTER_PITCHBEND_UP];
+    bendDown=image[MASTER_PITCHBEND_DOWN];
+
+    for (int op=0; op<6; op++) {
+        ams[op]=image[OP_AMS1+op]/255.0f;
+        pms[op]=image[OP_PMS_1+op]/255.0f;
+    }
+
+    // The range is how far L0-L5 can take the pitch either way, up to 4 octaves
+    pitchRange=image[PITCH_EG_RANGE]/255.0f*48;
+    pitchVelocity=image[PITCH_EG_VELO]/255.0f;
+    pitchRateKey=image[PITCH_EG_RATE_KEY]/255.0f;
+    pitchEG=false;
+
+    for (int s=0; s<6; s++) {
+        pitchLevel[s]=image[levels[s]];
+        pitchEG=pitchEG || (pitchRange > 0 && image[levels[s]] != 128);
+    }
+
+    pitchTime[0]=image[PITCH_EG_DELAY] == 0 ? 0 : xfmRateToSeconds(image[PITCH_EG_DELAY])/4;
+    for (int s=1; s<6; s++) {
+        pitchTime[s]=xfmRateToSeconds(image[rates[s]]);
+    }
+
+    loop=image[OP_EG_LOOP] & 0x3f;
+    loopSegment=image[OP_EG_LOOP_SEG] & 0x3f;
+}
+
+float XFMModulationParams::pitchDepth(const XFMControllers &c) const
+{
+    float d=lfoPitch+c.wheel*pitchLFO[0]+c.aftertouch*pitchLFO[1]+c.breath*pitchLFO[2]+c.foot*pitchLFO[3];
+    return d > 1 ? 1 : d;
+}
+
+float XFMModulationParams::ampDepth(const XFMControllers &c) const
+{
+    float d=lfoAmp+c.wheel*ampLFO[0]+c.aftertouch*ampLFO[1]+c.breath*ampLFO[2]+c.foot*ampLFO[3];
+    return d > 1 ? 1 : d;
+}
+
+float XFMModulationParams::biasDepth(const XFMControllers &c) const
+{
+    float d=c.wheel*bias[0]+c.aftertouch*bias[1]+c.breath*bias[2]+c.foot*bias[3];
+    return d > 1 ? 1 : d;
+}
+
+float XFMModulationParams::pitchOffset(const XFMControllers &c) const
+{
+    return c.bend*(c.bend >= 0 ? bendUp : bendDown)+c.aftertouch*pitch[1]+c.breath*pitch[2]+c.foot*pitch[3];
+}
+
+float xfmLFO(int wave, double cycles, uint32_t seed)
+{
+    double whole=floor(cycles);
+    float p=static_cast<float>(cycles-whole);
+
+    switch (wave) {
+        case 0:
+            return (p < 0.5f) ? 4*p-1 : 3-4*p;
+        case 1:
+            return (p < 0.5f) ? 1 : -1;
+        case 2:
+            return 2*p-1;
+        case 3:
+            return 1-2*p;
+        case 4:
+            return xfmSine(p);
+        default: {
+            // Hash the cycle number, so every voice sharing a seed agrees
+            uint32_t h=static_cast<uint32_t>(static_cast<int64_t>(whole))^seed;
+
+            h^=h >> 16;
+            h*=0x7feb352d;
+            h^=h >> 15;
+            h*=0x846ca68b;
+            h^=h >> 16;
+            return (h/4294967295.0f)*2-1;
+        }
+    }
+}
+
+void XFMPitchEnvelope::start(const XFMModulationParams &params, int note, float velocity, float sampleRate)
+{
+    m_stage=0;
+    m_level=params.pitchLevel[0];
+    m_delay=static_cast<int>(params.pitchTime[0]*sampleRate);
+    m_depth=params.pitchRange/128*(1-params.pitchVelocity*(1-velocity));
+    m_speed=exp2f((note-60)/12.0f*params.pitchRateKey)/sampleRate;
+}
+
+void XFMPitchEnvelope::release()
+{
+    if (m_stage < 6) {
+        m_stage=6;
+    }
+}
+
+float XFMPitchEnvelope::advance(const XFMModulationParams &params, int samples)
+{
+    if (!params.pitchEG) {
+        return 0;
+    }
+
+    if (m_stage == 0) {
+        m_delay-=samples;
+        if (m_delay <= 0) {
+            m_stage=1;
+        }
+    } else if ((m_stage >= 1 && m_stage <= 4) || m_stage == 6) {
+        int segment=(m_stage == 6) ? 5 : m_stage;
+        float target=params.pitchLevel[segment];
+        float step=255.0f*samples*m_speed/params.pitchTime[segment];
+
+        if (m_level < target) {
+            m_level=fminf(m_level+step, target);
+        } else {
+            m_level=fmaxf(m_level-step, target);
+        }
+
+        if (m_level == target) {
+            m_stage=(m_stage == 6) ? 7 : m_stage+1;
+        }
+    }
+
+    return (m_level-128)*m_depth;
+}
@@ -0,0 +1,129 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMMODSOURCES_H
+#define XFMMODSOURCES_H
+
+#include <stdint.h>
+
+// Envelope rates are stored as times.  0 is about 1ms, 255 about 20 seconds
+float xfmRateToSeconds(int raw);
+
+// Where the performance controllers are, 0-1, apart from the pitch bend, which is -1 to 1
+struct XFMControllers {
+    float   wheel;
+    float   aftertouch;
+    float   breath;
+    float   foot;
+    float   bend;
+};
+
+/*
+ * The state of the controllers, and the time (in samples since rendering
+ * began) at the start of a render call.  Voices work out their LFO and
+ * fade from the time, so they can be rendered on any thread, in any order.
+ */
+struct XFMControlFrame {
+    XFMControllers  controllers;
+    uint64_t        time;
+    uint64_t        lfoOrigin;      // When the shared LFO was last restarted
+};
+
+/*
+ * What a patch does with its modulation sources: the LFO, the pitch EG,
+ * the controllers and the envelope loops.  Depths are 0-1 and pitches in
+ * semitones.
+ */
+struct XFMModulationParams {
+    enum Sync { SingleFree, SingleKey, MultiFree, MultiKey };
+
+    int     lfoWave;                // Triangle, square, saw up, saw down, sine, random
+    int     lfoSync;
+    float   lfoHz;
+    float   lfoFade;                // Seconds to fade in from the note starting, 0 for none
+    float   lfoPitch;               // LFO_DEPTH_PITCH.  At 1 the LFO moves pitch an octave
+    float   lfoAmp;                 // LFO_DEPTH_AMP
+
+    // Depth each controller adds at full travel
+    float   pitchLFO[4];            // Wheel, aftertouch, breath, foot
+    float   ampLFO[4];
+    float   bias[4];                // EG bias, which turns down operators with AMS
+    float   pitch[4];               // Direct pitch, in semitones.  There's none from the wheel
+
+    float   randomPitch;            // The most a note is detuned by, either way
+    float   bendUp;
+    float   bendDown;
+
+    float   ams[6];
+    float   pms[6];
+
+    float   pitchLevel[6];          // L0-L5, 0-255 with 128 in tune
+    float   pitchTime[6];           // Delay then R1-R5, in seconds for a full scale move
+    float   pitchRange;             // Semitones at 0 and 255
+    float   pitchVelocity;
+    float   pitchRateKey;           // How much faster the pitch EG runs an octave up
+
+    unsigned char   loop;           // OP_EG_LOOP, a bit per operator
+    unsigned char   loopSegment;    // OP_EG_LOOP_SEG, a bit per operator
+
+    bool    pitchEG;                // The pitch EG moves
+    bool    lfo;                    // Anything uses the LFO
+
+    void decode(const unsigned char *image);
+
+    // Total depth from the patch and controllers, up to 1
+    float pitchDepth(const XFMControllers &c) const;
+    float ampDepth(const XFMControllers &c) const;
+    float biasDepth(const XFMControllers &c) const;
+
+    // Pitch offset from the bend and direct pitch controllers, in semitones
+    float pitchOffset(const XFMControllers &c) const;
+};
+
+// The LFO at a point in its cycle, -1 to 1.  Random holds one value per
+// cycle, picked by the cycle number and seed
+float xfmLFO(int wave, double cycles, uint32_t seed);
+
+/*
+ * The pitch EG.  It runs the same way as an operator's envelope: a delay
+ * at L0, on through L1 to L4, holding L4 until the note is released, then
+ * on to L5.
+ */
+class XFMPitchEnvelope {
+public:
+    void start(const XFMModulationParams &params, int note, float velocity, float sampleRate);
+    void release();
+
+    // Move on a number of samples and return the offset in semitones
+    float advance(const XFMModulationParams &params, int samples);
+
+private:
+    int     m_stage;            // 0 delay, 1-4 moving to L1-L4, 5 sustain, 6 release, 7 finished
+    float   m_level;
+    int     m_delay;
+    float   m_depth;            // Semitones per step, with the velocity
+    float   m_speed;            // Full scale moves per sample, before the rate
+};
+
+#endif // XFMMODSOURCES_H
@@ -0,0 +1,285 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include "xfmmodulation.h"
+#include "xfmdevice.h"
+
+// Default control rate, ticks per second
+#define CONTROLRATE 100
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+XFMModulation::XFMModulation(XFMDevice *device, QObject *parent) : QObject(parent)
+{
+    m_device=device;
+    m_nextId=1;
+    m_random=0x2545f491;
+
+    m_timer=new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(1000/CONTROLRATE);
+    connect(m_timer, &QTimer::timeout, this, &XFMModulation::tick);
+}
+
+int XFMModulation::add(int unit, int offset, XFMModulator::Shape shape, double rate, int depth)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return -1;
+    }
+
+    XFMModulator m;
+
+    m.id=m_nextId++;
+    m.shape=shape;
+    m.unit=unit;
+    m.offset=offset;
+    m.rate=rate;
+    m.depth=depth;
+    m.base=m_device->unit(unit).buffer[offset];
+    m.attack=0.01;
+    m.decay=0.5;
+    m.phase=0;
+    m.held=nextRandom();
+
+    // If the target is already modulated, share its centre
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].unit == unit && m_modulators[i].offset == offset) {
+            m.base=m_modulators[i].base;
+            break;
+        }
+    }
+
+    m_modulators.push_back(m);
+
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+
+    return m.id;
+}
+
+bool XFMModulation::remove(int id)
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].id == id) {
+            int unit=m_modulators[i].unit;
+            int offset=m_modulators[i].offset;
+
+            m_modulators.erase(m_modulators.begin()+static_cast<long>(i));
+            restore(unit, offset);
+
+            if (m_modulators.empty()) {
+                m_timer->stop();
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void XFMModulation::clear()
+{
+    while (!m_modulators.empty()) {
+        remove(m_modulators.back().id);
+    }
+}
+
+XFMModulator *XFMModulation::find(int id)
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].id == id) {
+            return &m_modulators[i];
+        }
+    }
+
+    return nullptr;
+}
+
+int XFMModulation::count() const
+{
+    return static_cast<int>(m_modulators.size());
+}
+
+void XFMModulation::trigger()
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        m_modulators[i].phase=0;
+    }
+}
+
+void XFMModulation::rebase(int unit, int offset, unsigned char value)
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].unit == unit && m_modulators[i].offset == offset) {
+            m_modulators[i].base=value;
+        }
+    }
+}
+
+void XFMModulation::rebaseUnit(int unit)
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].unit == unit) {
+            m_modulators[i].base=m_device->unit(unit).buffer[m_modulators[i].offset];
+        }
+    }
+}
+
+void XFMModulation::setRate(int hz)
+{
+    if (hz < 1) hz=1;
+    if (hz > 1000) hz=1000;
+
+    m_timer->setInterval(1000/hz);
+}
+
+int XFMModulation::rate() const
+{
+    return 1000/m_timer->interval();
+}
+
+// Once nothing modulates a parameter the synth goes back to the edit
+// buffer's value, which is where the modulation was centred
+void XFMModulation::restore(int unit, int offset)
+{
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        if (m_modulators[i].unit == unit && m_modulators[i].offset == offset) {
+            return;
+        }
+    }
+
+    m_device->scheduler()->modulate(unit, offset, m_device->unit(unit).buffer[offset]);
+}
+
+// xorshift32, scaled to -1..1
+double XFMModulation::nextRandom()
+{
+    m_random^=m_random << 13;
+    m_random^=m_random >> 17;
+    m_random^=m_random << 5;
+
+    return (m_random/4294967295.0)*2-1;
+}
+
+// Advance a modulator by dt seconds and return its output
+double XFMModulation::output(XFMModulator &m, double dt)
+{
+    if (m.shape == XFMModulator::Envelope) {
+        double t=m.phase;
+
+        m.phase+=dt;
+        if (t < m.attack) {
+            return m.attack > 0 ? t/m.attack : 1;
+        }
+        t-=m.attack;
+        if (t < m.decay) {
+            return 1-t/m.decay;
+        }
+        return 0;
+    }
+
+    // For steps the rate is steps per second, so a cycle runs through them all
+    double cycles=m.rate;
+    if (m.shape == XFMModulator::Steps && !m.steps.empty()) {
+        cycles/=static_cast<double>(m.steps.size());
+    }
+
+    double p=m.phase;
+    double next=p+cycles*dt;
+    bool wrapped=next >= 1;
+
+    m.phase=next-floor(next);
+
+    switch (m.shape) {
+        case XFMModulator::Sine:
+            return sin(2*M_PI*p);
+
+        case XFMModulator::Triangle:
+            return (p < 0.5) ? 4*p-1 : 3-4*p;
+
+        case XFMModulator::Saw:
+            return 2*p-1;
+
+        case XFMModulator::Square:
+            return (p < 0.5) ? 1 : -1;
+
+        case XFMModulator::Random:
+            if (wrapped) {
+                m.held=nextRandom();
+            }
+            return m.held;
+
+        case XFMModulator::Steps: {
+            if (m.steps.empty()) {
+                return 0;
+            }
+
+            size_t n=m.steps.size();
+            size_t step=static_cast<size_t>(p*n)%n;
+            return m.steps[step];
+        }
+
+        default:
+            return 0;
+    }
+}
+
+void XFMModulation::tick()
+{
+    double dt=m_timer->interval()/1000.0;
+    int sums[XFM2_UNITS*512];
+    bool touched[XFM2_UNITS*512]={};
+
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        XFMModulator &m=m_modulators[i];
+        int slot=m.unit*512+m.offset;
+        double out=output(m, dt);
+
+        if (!touched[slot]) {
+            touched[slot]=true;
+            sums[slot]=m.base;
+        }
+        sums[slot]+=static_cast<int>(lround(out*m.depth));
+    }
+
+    XFMParameterScheduler *scheduler=m_device->scheduler();
+
+    for (size_t i=0; i<m_modulators.size(); i++) {
+        int slot=m_modulators[i].unit*512+m_modulators[i].offset;
+
+        if (!touched[slot]) {
+            continue;
+        }
+        touched[slot]=false;
+
+        int v=sums[slot];
+        if (v < 0) v=0;
+        if (v > 255) v=255;
+
+        scheduler->modulate(m_modulators[i].unit, m_modulators[i].offset, static_cast<unsigned char>(v));
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMMODULATION_H
+#define XFMMODULATION_H
+
+#include <QObject>
+#include <QTimer>
+#include <vector>
+
+class XFMDevice;
+
+/*
+ * A controller side modulator.  The value sent to the synth is
+ * base+depth*output, where output runs from -1 to 1 (0 to 1 for the
+ * envelope) and base is the parameter's value from the edit buffer.  Only
+ * the synth gets the modulated value; the edit buffer keeps base.
+ */
+struct XFMModulator {
+    enum Shape { Sine, Triangle, Saw, Square, Random, Envelope, Steps };
+
+    int                 id;
+    Shape               shape;
+    int                 unit;
+    int                 offset;         // Target parameter
+    double              rate;           // Cycles (or steps) per second
+    int                 depth;          // Swing either side of base, in parameter units
+    int                 base;           // Value the modulation is centred on
+    double              attack;         // Envelope attack, in seconds
+    double              decay;          // Envelope decay, in seconds
+    std::vector<double> steps;          // Step values, -1 to 1
+
+    // Running state
+    double              phase;          // 0 to 1 through the cycle (seconds since trigger for the envelope)
+    double              held;           // Current random value
+};
+
+/*
+ * Runs modulators against any parameter at a fixed control rate.
+ *
+ * The XFM2's own LFO only reaches pitch and amplitude, so these fill the gap
+ * for everything else (FX_PHASER_OFFSET, OP_LEVEL and so on).  Each control
+ * tick works out every modulator, adds up the ones that share a target and
+ * hands the results to the device's scheduler, which sends them within its
+ * share of the link.  Editing a modulated parameter by hand moves the
+ * centre of its modulation rather than fighting it.
+ */
+class XFMModulation : public QObject {
+    Q_OBJECT
+
+public:
+    explicit XFMModulation(XFMDevice *device, QObject *parent = nullptr);
+
+    // Add a modulator.  Returns its id, or -1 if the target is out of range
+    int add(int unit, int offset, XFMModulator::Shape shape, double rate, int depth);
+    bool remove(int id);
+    void clear();
+
+    XFMModulator *find(int id);
+    int count() const;
+
+    // Restart every envelope and put every cycle back to its start
+    void trigger();
+
+    // A parameter was edited by hand, so modulate around its new value
+    void rebase(int unit, int offset, unsigned char value);
+
+    // A new patch was loaded into the unit, so take every centre from it
+    void rebaseUnit(int unit);
+
+    // Control rate in ticks per second
+    void setRate(int hz);
+    int rate() const;
+
+private slots:
+    void tick();
+
+private:
+    double output(XFMModulator &m, double dt);
+    double nextRandom();
+    void restore(int unit, int offset);
+
+    XFMDevice *                 m_device;
+    QTimer *                    m_timer;
+    std::vector<XFMModulator>   m_modulators;
+    int                         m_nextId;
+    unsigned int                m_random;       // State for the random shape
+};
+
+#endif // XFMMODULATION_H
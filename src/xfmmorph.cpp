@@ -0,0 +1,136 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "xfmmorph.h"
+#include "xfmparameterinfo.h"
+
+XFMMorph::XFMMorph()
+{
+    for (int offset=0; offset<512; offset++) {
+        if (XFMParameterInfo::isContinuous(offset)) {
+            m_continuous.push_back(static_cast<unsigned short>(offset));
+        } else {
+            m_discrete.push_back(static_cast<unsigned short>(offset));
+        }
+    }
+}
+
+void XFMMorph::clear()
+{
+    m_sources.clear();
+}
+
+int XFMMorph::addSource(const unsigned char *image)
+{
+    m_sources.insert(m_sources.end(), image, image+512);
+    return sourceCount();
+}
+
+int XFMMorph::sourceCount() const
+{
+    return static_cast<int>(m_sources.size()/512);
+}
+
+void XFMMorph::render(double position, unsigned char *out) const
+{
+    int count=sourceCount();
+
+    if (count == 0) {
+        return;
+    }
+
+    if (position <= 0 || count == 1) {
+        memcpy(out, &m_sources[0], 512);
+        return;
+    }
+    if (position >= count-1) {
+        memcpy(out, &m_sources[(count-1)*512], 512);
+        return;
+    }
+
+    int index=static_cast<int>(position);
+    double t=position-index;
+    const unsigned char *a=&m_sources[index*512];
+    const unsigned char *b=a+512;
+
+    // Fixed point weight so the inner loop stays in integers
+    int w=static_cast<int>(t*256+0.5);
+
+    for (size_t i=0; i<m_continuous.size(); i++) {
+        int offset=m_continuous[i];
+        int va=a[offset];
+
+        out[offset]=static_cast<unsigned char>(va+(((b[offset]-va)*w+128)>>8));
+    }
+
+    const unsigned char *nearest=(t < 0.5) ? a : b;
+    for (size_t i=0; i<m_discrete.size(); i++) {
+        out[m_discrete[i]]=nearest[m_discrete[i]];
+    }
+}
+
+void XFMMorph::renderWeighted(const double *weights, unsigned char *out) const
+{
+    int count=sourceCount();
+    double total=0;
+    int heaviest=0;
+
+    if (count == 0) {
+        return;
+    }
+
+    // A negative weight counts as 0, which keeps every blend between the
+    // sources and so in range for a byte
+    for (int s=0; s<count; s++) {
+        if (weights[s] > 0) {
+            total+=weights[s];
+        }
+        if (weights[s] > weights[heaviest]) {
+            heaviest=s;
+        }
+    }
+
+    if (total <= 0) {
+        memcpy(out, &m_sources[0], 512);
+        return;
+    }
+
+    for (size_t i=0; i<m_continuous.size(); i++) {
+        int offset=m_continuous[i];
+        double v=0;
+
+        for (int s=0; s<count; s++) {
+            if (weights[s] > 0) {
+                v+=weights[s]*m_sources[s*512+offset];
+            }
+        }
+
+        out[offset]=static_cast<unsigned char>(v/total+0.5);
+    }
+
+    const unsigned char *nearest=&m_sources[heaviest*512];
+    for (size_t i=0; i<m_discrete.size(); i++) {
+        out[m_discrete[i]]=nearest[m_discrete[i]];
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMMORPH_H
+#define XFMMORPH_H
+
+#include <vector>
+
+/*
+ * Blends two or more patch images into one.
+ *
+ * Continuous parameters are interpolated, while discrete ones (see
+ * XFMParameterInfo) come from whichever source has the most weight, so an
+ * algorithm or waveform switches cleanly half way rather than passing
+ * through meaningless values.  The discrete offsets are worked out once,
+ * so rendering is just a pass over the continuous ones.
+ */
+
+class XFMMorph {
+public:
+    XFMMorph();
+
+    void clear();
+
+    // Add a 512 byte patch image.  Returns the number of sources
+    int addSource(const unsigned char *image);
+    int sourceCount() const;
+
+    // Render a point along the chain of sources.  0 is the first source,
+    // sourceCount()-1 the last, and 1.5 is half way between the second and third
+    void render(double position, unsigned char *out) const;
+
+    // Render a weighted blend of every source.  weights holds one entry per
+    // source, and doesn't need to add up to one.  Negative weights count as 0
+    void renderWeighted(const double *weights, unsigned char *out) const;
+
+private:
+    std::vector<unsigned char>  m_sources;      // sourceCount() images of 512 bytes
+    std::vector<unsigned short> m_continuous;   // Offsets that are interpolated
+    std::vector<unsigned short> m_discrete;     // Offsets that are switched
+};
+
+#endif // XFMMORPH_H
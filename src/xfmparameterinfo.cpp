@@ -0,0 +1,67 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xfmparameterinfo.h"
+#include "xfm2.h"
+
+// Ranges of continuous parameters, inclusive.  Gaps between the operator
+// envelope blocks are unused offsets and harmless either way
+static const int continuousRanges[][2]={
+    { OP_FEEDBACK1, OP_FEEDBACK6 },
+    { OP_RATIOFINE1, OP_KEY_RDEPTH6 },
+    { OP_LEVEL1_1, OP_RATE4_6 },
+    { PITCH_EG_L1, LFO_SPEED },
+    { LFO_FADE, OP_AMS6 },
+    { MASTER_PITCHBEND_UP, MASTER_TRANSPOSE },
+    { MASTER_VOLUME, OP_PMS_6 },
+    { MASTER_PORTAMENTO_TIME, MASTER_PORTAMENTO_TIME },
+    { MASTER_VELOCITY_OFFSET, MASTER_VELOCITY_OFFSET },
+    { MASTER_TUNING, MASTER_TUNING },
+    { OP_LEVEL_LEFT1, OP_LEVEL_RIGHT6 },
+    { FX_DELAY_DRY, FX_DELAY_WET },
+    { FX_DELAY_TIME, FX_DELAY_TEMPO },
+    { FX_PHASER_DRY, FX_PHASER_WET },
+    { FX_PHASER_DEPTH, FX_PHASER_OFFSET },
+    { FX_PHASER_LRPHASE, FX_PHASER_LRPHASE },
+    { FX_FILTER_LO, FX_FILTER_HI },
+    { FX_AM_SPEED, FX_AM_LRPHASE },
+    { FX_CHORUS_DRY, FX_CHORUS_WET },
+    { FX_CHORUS_SPEED, FX_CHORUS_LRPHASE },
+    { FX_DECIMATOR_DEPTH, FX_DECIMATOR_DEPTH },
+    { FX_BITCRUSHER_DEPTH, FX_BITCRUSHER_DEPTH },
+    { FX_REVERB_DRY, FX_REVERB_WET },
+    { FX_REVERB_DECAY, FX_REVERB_DAMP },
+    { MASTER_OUTPUT, MASTER_OUTPUT },
+    { ARPEGGIATOR_TEMPO, ARPEGGIATOR_TEMPO }
+};
+
+bool XFMParameterInfo::isContinuous(int offset)
+{
+    for (unsigned int i=0; i<sizeof(continuousRanges)/sizeof(continuousRanges[0]); i++) {
+        if (offset >= continuousRanges[i][0] && offset <= continuousRanges[i][1]) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,43 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMPARAMETERINFO_H
+#define XFMPARAMETERINFO_H
+
+/*
+ * What the controller knows about each of the 512 parameter offsets.
+ *
+ * Continuous parameters (levels, rates, wet/dry mixes and so on) can be
+ * swept through every value in between.  Discrete ones (algorithm bitmasks,
+ * waveforms, modes, routing) only make sense as one of their values, so
+ * anything that blends patches has to switch them instead.  Offsets that
+ * aren't in xfm2.h are treated as discrete so they're never blended.
+ */
+
+class XFMParameterInfo {
+public:
+    static bool isContinuous(int offset);
+    static bool isDiscrete(int offset) { return !isContinuous(offset); }
+};
+
+#endif // XFMPARAMETERINFO_H
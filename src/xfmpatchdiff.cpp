@@ -0,0 +1,104 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "xfmpatchdiff.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XFM2_DIFF_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define XFM2_DIFF_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int lowestBit(unsigned int mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+}
+#else
+static inline int lowestBit(unsigned int mask)
+{
+    return __builtin_ctz(mask);
+}
+#endif
+
+#if !defined(XFM2_DIFF_SSE2)
+// Scan a block byte by byte
+static inline int scanBlock(const unsigned char *a, const unsigned char *b, int base, int length, unsigned short *offsets, int n)
+{
+    for (int i=0; i<length; i++) {
+        if (a[base+i] != b[base+i]) {
+            offsets[n++]=static_cast<unsigned short>(base+i);
+        }
+    }
+
+    return n;
+}
+#endif
+
+int XFMPatchDiff::diff(const unsigned char *a, const unsigned char *b, unsigned short *offsets)
+{
+    int n=0;
+
+#if defined(XFM2_DIFF_SSE2)
+    for (int base=0; base<PatchSize; base+=16) {
+        __m128i va=_mm_loadu_si128(reinterpret_cast<const __m128i *>(a+base));
+        __m128i vb=_mm_loadu_si128(reinterpret_cast<const __m128i *>(b+base));
+        unsigned int mask=~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xffff;
+
+        // One bit per differing byte
+        while (mask) {
+            offsets[n++]=static_cast<unsigned short>(base+lowestBit(mask));
+            mask&=mask-1;
+        }
+    }
+#elif defined(XFM2_DIFF_NEON)
+    for (int base=0; base<PatchSize; base+=16) {
+        uint8x16_t ne=veorq_u8(vld1q_u8(a+base), vld1q_u8(b+base));
+        uint64x2_t lanes=vreinterpretq_u64_u8(ne);
+
+        if ((vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0) {
+            n=scanBlock(a, b, base, 16, offsets, n);
+        }
+    }
+#else
+    for (int base=0; base<PatchSize; base+=8) {
+        uint64_t wa, wb;
+
+        // memcpy keeps this safe on CPUs that don't like unaligned loads
+        memcpy(&wa, a+base, 8);
+        memcpy(&wb, b+base, 8);
+        if (wa != wb) {
+            n=scanBlock(a, b, base, 8, offsets, n);
+        }
+    }
+#endif
+
+    return n;
+}
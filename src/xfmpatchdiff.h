@@ -0,0 +1,45 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMPATCHDIFF_H
+#define XFMPATCHDIFF_H
+
+/*
+ * Finds the bytes that differ between two 512 byte patch images.
+ *
+ * Most of the time two patches only differ in a handful of places, so the
+ * images are compared 16 bytes at a time (SSE2 on x86, NEON on the Pi, or
+ * 8 bytes at a time in plain C elsewhere) and only the blocks that differ
+ * are looked at byte by byte.
+ */
+
+class XFMPatchDiff {
+public:
+    enum { PatchSize=512 };
+
+    // Write the offset of every byte where a and b differ into offsets (which must
+    // hold PatchSize entries), in ascending order.  Returns the number of offsets
+    static int diff(const unsigned char *a, const unsigned char *b, unsigned short *offsets);
+};
+
+#endif // XFMPATCHDIFF_H
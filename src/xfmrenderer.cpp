@@ -0,0 +1,1065 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "xfmrenderer.h"
+#include "xfmalgorithm.h"
+#include "xfmkernels.h"
+#include "xfmworkpool.h"
+#include "xfm2.h"
+
+// How far a modulator at full level moves its carrier's phase, in cycles
+#define MODULATION_DEPTH    2.0f
+
+// The most a feedback amount of 255 moves an operator's own phase, in cycles
+#define FEEDBACK_DEPTH      0.5f
+
+// Levels are in roughly 0.19 dB steps, 32 to each 6 dB
+static inline float levelToAmp(float level)
+{
+    return level <= 0 ? 0 : exp2f((level-255)/32);
+}
+
+/*
+ * The amplitude of each envelope level in sixteenths of a step, for the
+ * fixed point engine.  Its waveforms come from XFMWaveTables
+ */
+#define FIXED_LEVEL_STEPS   16
+
+struct XFMFixedTables {
+    int32_t amp[256*FIXED_LEVEL_STEPS];
+
+    XFMFixedTables()
+    {
+        for (int i=0; i<256*FIXED_LEVEL_STEPS; i++) {
+            amp[i]=static_cast<int32_t>(lrintf(32768.0f*levelToAmp(static_cast<float>(i)/FIXED_LEVEL_STEPS)));
+        }
+    }
+};
+
+static const XFMFixedTables &fixedTables()
+{
+    static const XFMFixedTables tables;
+    return tables;
+}
+
+void XFMPatchParams::decode(const unsigned char *image)
+{
+    static const int levels[6]={ OP_LEVEL0_1, OP_LEVEL1_1, OP_LEVEL2_1, OP_LEVEL3_1, OP_LEVEL4_1, OP_LEVEL5_1 };
+    static const int rates[6]={ OP_DELAY_1, OP_RATE1_1, OP_RATE2_1, OP_RATE3_1, OP_RATE4_1, OP_RATE5_1 };
+
+    for (int op=0; op<6; op++) {
+        feedback[op]=image[OP_FEEDBACK1+op]/255.0f*FEEDBACK_DEPTH;
+
+        // A ratio of 0 means a half, and ratio fine adds up to one more
+        float r=image[OP_RATIO1+op] == 0 ? 0.5f : image[OP_RATIO1+op];
+        r+=image[OP_RATIOFINE1+op]/256.0f;
+
+        // Fine tunes up to a semitone either way of 128
+        ratio[op]=r*exp2f((image[OP_FINE1+op]-128)/(128.0f*12.0f));
+
+        keyTrack[op]=(image[OP_MODE] & (1 << op)) != 0;
+        gain[op]=levelToAmp(image[OP_LEVEL1+op]);
+        velocitySens[op]=image[OP_VELO_SENS1+op]/255.0f;
+        left[op]=image[OP_LEVEL_LEFT1+op*2]/255.0f;
+        right[op]=image[OP_LEVEL_RIGHT1+op*2]/255.0f;
+
+        for (int s=0; s<6; s++) {
+            envLevel[op][s]=image[levels[s]+op];
+        }
+
+        // The delay isn't stored inverted like the rates, and 0 means none
+        envTime[op][0]=image[OP_DELAY_1+op] == 0 ? 0 : xfmRateToSeconds(image[OP_DELAY_1+op])/4;
+        for (int s=1; s<6; s++) {
+            envTime[op][s]=xfmRateToSeconds(image[rates[s]+op]);
+        }
+    }
+
+    volume=image[MASTER_VOLUME]/255.0f;
+
+    // Transpose is 24 for none, and tuning 128 for A at 440 Hz, with up to a semitone either way
+    mono=image[MASTER_LEGATO] != 0;
+    portamento=image[MASTER_PORTAMENTO_MODE];
+    if (portamento > Fingered) portamento=Fingered;
+    glideTime=image[MASTER_PORTAMENTO_TIME] == 0 ? 0 : xfmRateToSeconds(image[MASTER_PORTAMENTO_TIME])/4;
+    egRestart=image[MASTER_EG_RESTART] != 0;
+    tune=(image[MASTER_TRANSPOSE]-24)+(image[MASTER_TUNING]-128)/128.0f;
+
+    plan=XFMAlgorithm::compile(&image[ALGO1]);
+    mod.decode(image);
+
+    for (int op=0; op<6; op++) {
+        feedbackQ12[op]=static_cast<int32_t>(lrintf(feedback[op]*4096));
+        leftQ15[op]=static_cast<int32_t>(lrintf(left[op]*volume*32768));
+        rightQ15[op]=static_cast<int32_t>(lrintf(right[op]*volume*32768));
+    }
+
+    for (int op=0; op<6; op++) {
+        int mode=image[OP_WMODE_1+op];
+
+        wave[op]=image[OP_WAVE1_1+op] & (XFMWaveTables::Waves-1);
+        blended[op]=(mode & 1) != 0;
+        sine[op]=!blended[op] && wave[op] == 0;
+
+        if (blended[op]) {
+            XFMWaveTables::blend(wave[op], image[OP_WAVE2_1+op], mode, image[OP_WRATIO_1+op], blendTable[op], blendTableQ15[op]);
+        }
+    }
+}
+
+// One operator's waveform at phase x, in cycles
+static inline float waveAt(const XFMPatchParams &patch, int op, float x)
+{
+    return patch.sine[op] ? xfmSine(x) : XFMWaveTables::lookup(patch.waveTable(op), x);
+}
+
+XFMVoice::XFMVoice()
+{
+    m_active=false;
+    m_released=false;
+    m_note=-1;
+    m_sampleRate=48000;
+    m_velocity=0;
+    m_kernels=&XFMKernels::best();
+    m_fixed=false;
+}
+
+void XFMVoice::noteOn(const XFMPatchParams &patch, int note, int velocity, float sampleRate, uint64_t time/*=0*/)
+{
+    m_active=true;
+    m_released=false;
+    m_note=note;
+    m_sampleRate=sampleRate;
+    m_velocity=velocity/127.0f;
+    m_pitch=note+patch.tune;
+    m_target=m_pitch;
+    m_glide=0;
+    m_start=time;
+
+    float hz=440.0f*exp2f((m_pitch-69)/12.0f);
+
+    // The seed picks the random detune, a multi free LFO's phase and a
+    // multi LFO's random values
+    m_seed=static_cast<uint32_t>(time*2654435761u)^static_cast<uint32_t>(note*40503);
+    m_seed^=m_seed << 13;
+    m_seed^=m_seed >> 17;
+    m_seed^=m_seed << 5;
+    m_detune=((m_seed >> 8)/16777215.0f*2-1)*patch.mod.randomPitch;
+    m_lfoOffset=(m_seed & 0xffff)/65536.0f;
+    m_pitchEnv.start(patch.mod, note, m_velocity, sampleRate);
+
+    for (int op=0; op<6; op++) {
+        // Fixed frequency operators play as though A4 was held
+        float f=(patch.keyTrack[op] ? hz : 440.0f)*patch.ratio[op];
+
+        m_phase[op]=0;
+        m_increment[op]=f/sampleRate;
+        m_tuned[op]=m_pitch;
+        m_modGain[op]=1;
+        m_modGainQ[op]=32768;
+        m_amp[op]=0;
+        m_last[op][0]=0;
+        m_last[op][1]=0;
+        m_env[op].stage=0;
+        m_env[op].level=patch.envLevel[op][0];
+        m_env[op].delay=static_cast<int>(patch.envTime[op][0]*sampleRate);
+        m_env[op].levelQ16=static_cast<int32_t>(patch.envLevel[op][0])<<16;
+
+        // Everything the fixed point engine needs that depends on the note
+        float velocityGain=1-patch.velocitySens[op]*(1-m_velocity);
+
+        m_phaseQ[op]=0;
+        m_incrementQ[op]=static_cast<uint32_t>(llrintf(m_increment[op]*4294967296.0f));
+        m_ampQ[op]=0;
+        m_gainQ[op]=static_cast<int32_t>(lrintf(patch.gain[op]*velocityGain*32768));
+        m_lastQ[op][0]=0;
+        m_lastQ[op][1]=0;
+
+        for (int s=1; s<6; s++) {
+            float step=255.0f*65536/(patch.envTime[op][s]*sampleRate);
+            m_stepQ[op][s]=static_cast<int32_t>(step < 65536.0f*255 ? step : 65536.0f*255);
+            if (m_stepQ[op][s] < 1) m_stepQ[op][s]=1;
+        }
+    }
+}
+
+void XFMVoice::setKernels(const XFMKernels *kernels)
+{
+    m_kernels=kernels;
+}
+
+void XFMVoice::setFixedPoint(bool fixed)
+{
+    m_fixed=fixed;
+}
+
+// Cut the voice off without a release
+void XFMVoice::stop()
+{
+    m_active=false;
+    m_released=false;
+    m_note=-1;
+}
+
+void XFMVoice::noteOff()
+{
+    if (!m_active || m_released) {
+        return;
+    }
+
+    m_released=true;
+    for (int op=0; op<6; op++) {
+        m_env[op].stage=6;
+    }
+    m_pitchEnv.release();
+}
+
+void XFMVoice::legato(const XFMPatchParams &patch, int note, bool restart)
+{
+    m_note=note;
+    m_pitch=note+patch.tune;
+    m_target=m_pitch;
+    m_glide=0;
+
+    if (!restart) {
+        return;
+    }
+
+    // No delay the second time round
+    m_pitchEnv.start(patch.mod, note, m_velocity, m_sampleRate);
+    for (int op=0; op<6; op++) {
+        m_env[op].stage=1;
+    }
+}
+
+void XFMVoice::glide(float from, float seconds)
+{
+    if (seconds <= 0 || from == m_target) {
+        return;
+    }
+
+    m_pitch=from;
+    m_glide=fabsf(m_target-from)/(seconds*m_sampleRate);
+}
+
+float XFMVoice::pitch() const
+{
+    return m_pitch;
+}
+
+bool XFMVoice::isActive() const
+{
+    return m_active;
+}
+
+bool XFMVoice::isReleased() const
+{
+    return m_released;
+}
+
+int XFMVoice::note() const
+{
+    return m_note;
+}
+
+/*
+ * The LFO, pitch EG and controllers, worked out for the end of a block of
+ * samples.  Amplitudes are ramped to their new value across the block, as
+ * the envelopes are, and pitch changes at the start of it.  An operator's
+ * increment is only worked out again if its pitch has moved
+ */
+void XFMVoice::control(const XFMPatchParams &patch, const XFMControlFrame &frame, uint64_t time, int samples)
+{
+    const XFMModulationParams &mod=patch.mod;
+    const XFMControllers &c=frame.controllers;
+
+    // Portamento moves at a steady rate, so it takes the same time however far it goes
+    if (m_pitch != m_target) {
+        float step=m_glide*samples;
+
+        if (fabsf(m_target-m_pitch) <= step) {
+            m_pitch=m_target;
+        } else {
+            m_pitch+=(m_target > m_pitch) ? step : -step;
+        }
+    }
+
+    float semitones=m_pitchEnv.advance(mod, samples)+mod.pitchOffset(c)+m_detune;
+    float lfo=0;
+    float pitchDepth=0;
+    float ampDepth=0;
+    float bias=mod.biasDepth(c);
+
+    if (mod.lfo) {
+        bool single=mod.lfoSync == XFMModulationParams::SingleFree || mod.lfoSync == XFMModulationParams::SingleKey;
+        uint64_t now=time+static_cast<uint64_t>(samples);
+        uint64_t origin=0;
+        double offset=0;
+
+        if (mod.lfoSync == XFMModulationParams::SingleKey) {
+            origin=frame.lfoOrigin;
+        } else if (mod.lfoSync == XFMModulationParams::MultiKey) {
+            origin=m_start;
+        } else if (mod.lfoSync == XFMModulationParams::MultiFree) {
+            offset=m_lfoOffset;
+        }
+
+        lfo=xfmLFO(mod.lfoWave, static_cast<double>(now-origin)*mod.lfoHz/m_sampleRate+offset, single ? 0x2545f491 : m_seed);
+
+        if (mod.lfoFade > 0) {
+            float fade=static_cast<float>(now-m_start)/(mod.lfoFade*m_sampleRate);
+            lfo*=(fade < 1) ? fade : 1;
+        }
+
+        pitchDepth=mod.pitchDepth(c);
+        ampDepth=mod.ampDepth(c);
+    }
+
+    for (int op=0; op<6; op++) {
+        if (patch.keyTrack[op]) {
+            float tuned=m_pitch+semitones+lfo*pitchDepth*mod.pms[op]*12;
+
+            if (tuned != m_tuned[op]) {
+                m_tuned[op]=tuned;
+                m_increment[op]=440.0f*exp2f((tuned-69)/12.0f)*patch.ratio[op]/m_sampleRate;
+                m_incrementQ[op]=static_cast<uint32_t>(llrintf(m_increment[op]*4294967296.0f));
+            }
+        }
+
+        m_modGain[op]=(1-ampDepth*mod.ams[op]*(0.5f-0.5f*lfo))*(1-bias*mod.ams[op]);
+        m_modGainQ[op]=static_cast<int32_t>(m_modGain[op]*32768);
+    }
+}
+
+// An operator with its envelope looping goes back round once it reaches
+// the sustain, while the note is held.  Normally it starts again from the
+// attack; with its loop segment bit set it only repeats L2 to L4
+void XFMVoice::loop(const XFMPatchParams &patch, int op)
+{
+    if (m_env[op].stage == 5 && !m_released && (patch.mod.loop & (1 << op)) != 0) {
+        m_env[op].stage=(patch.mod.loopSegment & (1 << op)) != 0 ? 3 : 1;
+    }
+}
+
+// Move an operator's envelope on by a number of samples and return its amplitude
+float XFMVoice::advance(const XFMPatchParams &patch, int op, int samples)
+{
+    Envelope &e=m_env[op];
+
+    if (e.stage == 0) {
+        e.delay-=samples;
+        if (e.delay <= 0) {
+            e.stage=1;
+        }
+    } else if ((e.stage >= 1 && e.stage <= 4) || e.stage == 6) {
+        int segment=(e.stage == 6) ? 5 : e.stage;
+        float target=patch.envLevel[op][segment];
+        float step=255.0f*samples/(patch.envTime[op][segment]*m_sampleRate);
+
+        if (e.level < target) {
+            e.level=fminf(e.level+step, target);
+        } else {
+            e.level=fmaxf(e.level-step, target);
+        }
+
+        if (e.level == target) {
+            e.stage=(e.stage == 6) ? 7 : e.stage+1;
+            loop(patch, op);
+        }
+    }
+
+    float velocity=1-patch.velocitySens[op]*(1-m_velocity);
+    return levelToAmp(e.level)*patch.gain[op]*velocity*m_modGain[op];
+}
+
+void XFMVoice::render(const XFMPatchParams &patch, const XFMControlFrame &frame, float *left, float *right, int frames)
+{
+    if (!m_active) {
+        return;
+    }
+
+    for (int done=0; done<frames; done+=XFM_RENDER_BLOCK) {
+        int n=(frames-done < XFM_RENDER_BLOCK) ? frames-done : XFM_RENDER_BLOCK;
+
+        control(patch, frame, frame.time+static_cast<uint64_t>(done), n);
+
+        if (m_fixed) {
+            renderFixed(patch, &left[done], &right[done], n);
+        } else if (patch.plan->serial) {
+            renderSerial(patch, &left[done], &right[done], n);
+        } else {
+            renderBlock(patch, &left[done], &right[done], n);
+        }
+    }
+
+    // The voice is finished once every carrier has finished its release
+    bool sounding=false;
+    for (int op=0; op<6; op++) {
+        if ((patch.plan->carriers & (1 << op)) != 0 && m_env[op].stage != 7) {
+            sounding=true;
+        }
+    }
+    m_active=sounding;
+}
+
+void XFMVoice::renderBlock(const XFMPatchParams &patch, float *left, float *right, int n)
+{
+    const XFMAlgorithmPlan &plan=*patch.plan;
+    float out[6][XFM_RENDER_BLOCK];
+    float mod[XFM_RENDER_BLOCK];
+
+    for (int k=0; k<plan.steps; k++) {
+        const XFMAlgorithmStep &step=plan.step[k];
+        int op=step.op;
+        float a0=m_amp[op];
+        float a1=advance(patch, op, n);
+        float da=(a1-a0)/n;
+        float phase=m_phase[op];
+        float inc=m_increment[op];
+        float *o=out[op];
+        bool modulated=step.sources > 0;
+
+        m_amp[op]=a1;
+
+        // Everything modulating this operator has already been worked out
+        if (modulated) {
+            memset(mod, 0, sizeof(float)*static_cast<size_t>(n));
+            for (int j=0; j<step.sources; j++) {
+                m_kernels->accumulate(out[step.source[j]], MODULATION_DEPTH, mod, n);
+            }
+        }
+
+        if (step.feedback && patch.feedback[op] > 0) {
+            float fb=patch.feedback[op];
+            float y0=m_last[op][0];
+            float y1=m_last[op][1];
+
+            if (!modulated) {
+                memset(mod, 0, sizeof(float)*static_cast<size_t>(n));
+            }
+
+            for (int i=0; i<n; i++) {
+                float y=waveAt(patch, op, phase+inc*i+mod[i]+fb*(y0+y1)*0.5f)*(a0+da*i);
+                y1=y0;
+                y0=y;
+                o[i]=y;
+            }
+
+            m_last[op][0]=y0;
+            m_last[op][1]=y1;
+        } else if (!patch.sine[op]) {
+            const float *table=patch.waveTable(op);
+
+            for (int i=0; i<n; i++) {
+                o[i]=XFMWaveTables::lookup(table, phase+inc*i+(modulated ? mod[i] : 0))*(a0+da*i);
+            }
+        } else if (modulated) {
+            m_kernels->modulate(phase, inc, mod, a0, da, o, n);
+        } else {
+            m_kernels->oscillate(phase, inc, a0, da, o, n);
+        }
+
+        phase+=inc*n;
+        m_phase[op]=phase-floorf(phase);
+
+        if (step.carrier) {
+            m_kernels->mix(o, patch.left[op]*patch.volume, patch.right[op]*patch.volume, left, right, n);
+        }
+    }
+}
+
+// A sample at a time.  Modulators later in the order give their last sample
+void XFMVoice::renderSerial(const XFMPatchParams &patch, float *left, float *right, int n)
+{
+    const XFMAlgorithmPlan &plan=*patch.plan;
+    float a0[6];
+    float da[6];
+
+    for (int k=0; k<plan.steps; k++) {
+        int op=plan.step[k].op;
+
+        a0[op]=m_amp[op];
+        m_amp[op]=advance(patch, op, n);
+        da[op]=(m_amp[op]-a0[op])/n;
+    }
+
+    for (int i=0; i<n; i++) {
+        float cur[6];
+
+        for (int op=0; op<6; op++) {
+            cur[op]=m_last[op][0];
+        }
+
+        for (int k=0; k<plan.steps; k++) {
+            const XFMAlgorithmStep &step=plan.step[k];
+            int op=step.op;
+            float phase=m_phase[op];
+
+            for (int j=0; j<step.sources; j++) {
+                phase+=cur[step.source[j]]*MODULATION_DEPTH;
+            }
+
+            if (step.feedback) {
+                phase+=patch.feedback[op]*(m_last[op][0]+m_last[op][1])*0.5f;
+            }
+
+            cur[op]=waveAt(patch, op, phase)*(a0[op]+da[op]*i);
+            m_last[op][1]=m_last[op][0];
+            m_last[op][0]=cur[op];
+
+            m_phase[op]+=m_increment[op];
+            m_phase[op]-=(m_phase[op] >= 1) ? 1 : 0;
+
+            if (step.carrier) {
+                left[i]+=cur[op]*patch.left[op]*patch.volume;
+                right[i]+=cur[op]*patch.right[op]*patch.volume;
+            }
+        }
+    }
+}
+
+// The same as advance(), in integers.  Returns the amplitude in 1.15
+int32_t XFMVoice::advanceFixed(const XFMPatchParams &patch, int op, int samples)
+{
+    Envelope &e=m_env[op];
+
+    if (e.stage == 0) {
+        e.delay-=samples;
+        if (e.delay <= 0) {
+            e.stage=1;
+        }
+    } else if ((e.stage >= 1 && e.stage <= 4) || e.stage == 6) {
+        int segment=(e.stage == 6) ? 5 : e.stage;
+        int32_t target=static_cast<int32_t>(patch.envLevel[op][segment])<<16;
+        int64_t step=static_cast<int64_t>(m_stepQ[op][segment])*samples;
+
+        if (e.levelQ16 < target) {
+            e.levelQ16=(target-e.levelQ16 <= step) ? target : e.levelQ16+static_cast<int32_t>(step);
+        } else {
+            e.levelQ16=(e.levelQ16-target <= step) ? target : e.levelQ16-static_cast<int32_t>(step);
+        }
+
+        if (e.levelQ16 == target) {
+            e.stage=(e.stage == 6) ? 7 : e.stage+1;
+            loop(patch, op);
+        }
+    }
+
+    int64_t amp=fixedTables().amp[e.levelQ16 >> (16-4)];
+    return static_cast<int32_t>((((amp*m_gainQ[op]) >> 15)*m_modGainQ[op]) >> 15);
+}
+
+/*
+ * The fixed point engine, a sample at a time like renderSerial().  A
+ * modulator at full level moves the phase by MODULATION_DEPTH (2) cycles,
+ * which is a shift from 1.15 into 0.32.  Amplitudes are ramped across the block
+ * with 8 more bits of precision than they're used at
+ */
+void XFMVoice::renderFixed(const XFMPatchParams &patch, float *left, float *right, int n)
+{
+    const XFMAlgorithmPlan &plan=*patch.plan;
+    const int16_t *wave[6];
+    int32_t a[6];
+    int32_t da[6];
+
+    for (int k=0; k<plan.steps; k++) {
+        int op=plan.step[k].op;
+        int32_t a1=advanceFixed(patch, op, n);
+
+        wave[op]=patch.waveTableQ15(op);
+        a[op]=m_ampQ[op] << 8;
+        da[op]=((a1-m_ampQ[op]) << 8)/n;
+        m_ampQ[op]=a1;
+    }
+
+    for (int i=0; i<n; i++) {
+        int32_t cur[6];
+        int32_t l=0;
+        int32_t r=0;
+
+        for (int op=0; op<6; op++) {
+            cur[op]=m_lastQ[op][0];
+        }
+
+        for (int k=0; k<plan.steps; k++) {
+            const XFMAlgorithmStep &step=plan.step[k];
+            int op=step.op;
+            uint32_t phase=m_phaseQ[op];
+
+            for (int j=0; j<step.sources; j++) {
+                phase+=static_cast<uint32_t>(cur[step.source[j]]) << 18;
+            }
+
+            if (step.feedback) {
+                phase+=static_cast<uint32_t>((m_lastQ[op][0]+m_lastQ[op][1])*patch.feedbackQ12[op]) << 4;
+            }
+
+            cur[op]=(wave[op][phase >> (32-XFMWaveTables::FixedBits)]*((a[op]+da[op]*i) >> 8)) >> 15;
+            m_lastQ[op][1]=m_lastQ[op][0];
+            m_lastQ[op][0]=cur[op];
+            m_phaseQ[op]+=m_incrementQ[op];
+
+            if (step.carrier) {
+                l+=(cur[op]*patch.leftQ15[op]) >> 15;
+                r+=(cur[op]*patch.rightQ15[op]) >> 15;
+            }
+        }
+
+        left[i]+=l*(1.0f/32768);
+        right[i]+=r*(1.0f/32768);
+    }
+}
+
+XFMRenderer::XFMRenderer(float sampleRate/*=48000*/, int polyphony/*=DefaultVoices*/) : m_effects(sampleRate)
+{
+    unsigned char init[512];
+
+    if (polyphony < 1) polyphony=1;
+
+    memset(init, 0, sizeof(init));
+    m_sampleRate=sampleRate;
+    m_clock=0;
+    memset(&m_frame, 0, sizeof(m_frame));
+    m_heldCount=0;
+    m_lastPitch=0;
+    m_played=false;
+    m_mode=Float;
+    m_effectsOn=true;
+    m_pool=nullptr;
+    m_voices.resize(static_cast<size_t>(polyphony));
+    m_age.assign(static_cast<size_t>(polyphony), 0);
+    m_sounding.reserve(static_cast<size_t>(polyphony));
+    m_patch.decode(init);
+}
+
+void XFMRenderer::loadPatch(const unsigned char *image)
+{
+    allNotesOff();
+    m_patch.decode(image);
+    m_effects.load(image);
+}
+
+const XFMPatchParams &XFMRenderer::patch() const
+{
+    return m_patch;
+}
+
+float XFMRenderer::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+/*
+ * A mono patch only uses the first voice.  A key pressed while another is
+ * held carries on the note that's playing at the new pitch, and letting it
+ * go returns to the last key still held, as the synth does.
+ */
+void XFMRenderer::noteOn(int note, int velocity)
+{
+    bool held=m_heldCount > 0;
+    int v=m_patch.mono ? 0 : allocate(note);
+    XFMVoice &voice=m_voices[static_cast<size_t>(v)];
+    float from=m_lastPitch;
+    bool glide=glides(held);
+
+    hold(note);
+
+    if (m_patch.mono && held && voice.isActive() && !voice.isReleased()) {
+        from=voice.pitch();
+        voice.legato(m_patch, note, m_patch.egRestart);
+    } else {
+        voice.noteOn(m_patch, note, velocity, m_sampleRate, m_frame.time);
+        m_frame.lfoOrigin=m_frame.time;
+    }
+
+    if (glide) {
+        voice.glide(from, m_patch.glideTime);
+    }
+
+    m_age[static_cast<size_t>(v)]=++m_clock;
+    m_lastPitch=note+m_patch.tune;
+    m_played=true;
+}
+
+void XFMRenderer::noteOff(int note)
+{
+    unhold(note);
+
+    if (m_patch.mono) {
+        XFMVoice &voice=m_voices[0];
+
+        if (!voice.isActive() || voice.isReleased() || voice.note() != note) {
+            return;
+        }
+
+        if (m_heldCount == 0) {
+            voice.noteOff();
+            return;
+        }
+
+        float from=voice.pitch();
+        int back=m_held[m_heldCount-1];
+
+        voice.legato(m_patch, back, m_patch.egRestart);
+        if (m_patch.portamento != XFMPatchParams::Off) {
+            voice.glide(from, m_patch.glideTime);
+        }
+        m_lastPitch=back+m_patch.tune;
+        return;
+    }
+
+    for (int i=0; i<polyphony(); i++) {
+        if (m_voices[i].isActive() && m_voices[i].note() == note) {
+            m_voices[i].noteOff();
+        }
+    }
+}
+
+// Stops effect tails as well
+void XFMRenderer::allNotesOff()
+{
+    for (int i=0; i<polyphony(); i++) {
+        m_voices[i].stop();
+    }
+    m_heldCount=0;
+    m_lastPitch=0;
+    m_played=false;
+    m_effects.reset();
+}
+
+/*
+ * Pick a voice for a note: the one already playing it, then a free one,
+ * then whichever was released longest ago, and only once all of them are
+ * held the oldest note
+ */
+int XFMRenderer::allocate(int note)
+{
+    int free=-1;
+    int released=-1;
+    int oldest=-1;
+
+    for (int i=0; i<polyphony(); i++) {
+        const XFMVoice &voice=m_voices[static_cast<size_t>(i)];
+        unsigned int age=m_age[static_cast<size_t>(i)];
+
+        if (!voice.isActive()) {
+            if (free < 0) free=i;
+        } else if (voice.note() == note) {
+            return i;
+        } else if (voice.isReleased()) {
+            if (released < 0 || age < m_age[static_cast<size_t>(released)]) released=i;
+        } else {
+            if (oldest < 0 || age < m_age[static_cast<size_t>(oldest)]) oldest=i;
+        }
+    }
+
+    if (free >= 0) return free;
+    if (released >= 0) return released;
+    return oldest;
+}
+
+// Keys down are kept in a fixed list.  If it fills the oldest is forgotten
+void XFMRenderer::hold(int note)
+{
+    unhold(note);
+
+    if (m_heldCount == HeldNotes) {
+        memmove(&m_held[0], &m_held[1], sizeof(int)*(HeldNotes-1));
+        m_heldCount--;
+    }
+    m_held[m_heldCount++]=note;
+}
+
+void XFMRenderer::unhold(int note)
+{
+    for (int i=0; i<m_heldCount; i++) {
+        if (m_held[i] == note) {
+            memmove(&m_held[i], &m_held[i+1], sizeof(int)*static_cast<size_t>(m_heldCount-i-1));
+            m_heldCount--;
+            return;
+        }
+    }
+}
+
+// Whether a new note glides from the last one.  Fingered portamento only
+// glides between notes played legato
+bool XFMRenderer::glides(bool held) const
+{
+    if (m_patch.portamento == XFMPatchParams::Off || m_patch.glideTime <= 0 || !m_played) {
+        return false;
+    }
+
+    return m_patch.portamento == XFMPatchParams::Always || held;
+}
+
+int XFMRenderer::activeVoices() const
+{
+    int n=0;
+
+    for (int i=0; i<polyphony(); i++) {
+        if (m_voices[i].isActive()) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+int XFMRenderer::polyphony() const
+{
+    return static_cast<int>(m_voices.size());
+}
+
+bool XFMRenderer::ringing() const
+{
+    return activeVoices() > 0 || (m_effectsOn && m_effects.ringing());
+}
+
+void XFMRenderer::setPool(XFMWorkPool *pool)
+{
+    m_pool=pool;
+
+    if (pool != nullptr) {
+        size_t workers=static_cast<size_t>(pool->workers());
+
+        m_scratch.resize(workers*ParallelFrames*2);
+        m_scratchUsed.resize(workers);
+    }
+}
+
+XFMWorkPool *XFMRenderer::pool() const
+{
+    return m_pool;
+}
+
+void XFMRenderer::render(float *left, float *right, int frames)
+{
+    if (m_pool != nullptr && m_pool->workers() > 1 && activeVoices() > 1) {
+        XFMControlFrame frame=m_frame;
+
+        for (int done=0; done<frames; done+=ParallelFrames) {
+            frame.time=m_frame.time+static_cast<uint64_t>(done);
+            renderParallel(frame, left+done, right+done, (frames-done < ParallelFrames) ? frames-done : ParallelFrames);
+        }
+    } else {
+        memset(left, 0, sizeof(float)*static_cast<size_t>(frames));
+        memset(right, 0, sizeof(float)*static_cast<size_t>(frames));
+
+        for (int i=0; i<polyphony(); i++) {
+            m_voices[i].render(m_patch, m_frame, left, right, frames);
+        }
+    }
+
+    if (m_effectsOn) {
+        m_effects.process(left, right, frames);
+    }
+
+    m_frame.time+=static_cast<uint64_t>(frames);
+}
+
+void XFMRenderer::setController(Controller controller, float value)
+{
+    switch (controller) {
+        case Wheel:         m_frame.controllers.wheel=value;        break;
+        case Aftertouch:    m_frame.controllers.aftertouch=value;   break;
+        case Breath:        m_frame.controllers.breath=value;       break;
+        case Foot:          m_frame.controllers.foot=value;         break;
+    }
+}
+
+void XFMRenderer::setPitchBend(float bend)
+{
+    m_frame.controllers.bend=bend;
+}
+
+/*
+ * One job per sounding voice.  A worker clears its buffer the first time it
+ * picks up a voice, so workers that found nothing to do cost nothing to mix.
+ * Each voice only touches its own state, and the patch is only read.  frames
+ * is at most ParallelFrames, which setPool() sized the buffers for
+ */
+void XFMRenderer::renderParallel(const XFMControlFrame &frame, float *left, float *right, int frames)
+{
+    size_t workers=static_cast<size_t>(m_pool->workers());
+    size_t stride=static_cast<size_t>(frames)*2;
+
+    std::fill(m_scratchUsed.begin(), m_scratchUsed.end(), 0);
+
+    m_sounding.clear();
+    for (int i=0; i<polyphony(); i++) {
+        if (m_voices[i].isActive()) {
+            m_sounding.push_back(i);
+        }
+    }
+
+    m_pool->parallelFor(static_cast<int>(m_sounding.size()), [&](int index, int worker) {
+        float *l=&m_scratch[static_cast<size_t>(worker)*stride];
+        float *r=l+frames;
+
+        if (!m_scratchUsed[static_cast<size_t>(worker)]) {
+            m_scratchUsed[static_cast<size_t>(worker)]=1;
+            memset(l, 0, sizeof(float)*stride);
+        }
+
+        m_voices[static_cast<size_t>(m_sounding[static_cast<size_t>(index)])].render(m_patch, frame, l, r, frames);
+    });
+
+    memset(left, 0, sizeof(float)*static_cast<size_t>(frames));
+    memset(right, 0, sizeof(float)*static_cast<size_t>(frames));
+
+    for (size_t w=0; w<workers; w++) {
+        if (!m_scratchUsed[w]) {
+            continue;
+        }
+
+        const float *l=&m_scratch[w*stride];
+        const float *r=l+frames;
+
+        for (int i=0; i<frames; i++) {
+            left[i]+=l[i];
+            right[i]+=r[i];
+        }
+    }
+}
+
+void XFMRenderer::setKernels(const XFMKernels &kernels)
+{
+    for (int i=0; i<polyphony(); i++) {
+        m_voices[i].setKernels(&kernels);
+    }
+}
+
+void XFMRenderer::setMode(Mode mode)
+{
+    allNotesOff();
+    m_mode=mode;
+
+    for (int i=0; i<polyphony(); i++) {
+        m_voices[i].setFixedPoint(mode == Fixed);
+    }
+}
+
+XFMRenderer::Mode XFMRenderer::mode() const
+{
+    return m_mode;
+}
+
+void XFMRenderer::setEffects(bool on)
+{
+    m_effectsOn=on;
+    m_effects.reset();
+}
+
+bool XFMRenderer::effects() const
+{
+    return m_effectsOn;
+}
+
+/*
+ * How many voices of the loaded patch one core can keep going in real time.
+ * Every voice is started, on notes spread over the keyboard, and held for
+ * a few seconds of audio
+ */
+double XFMRenderer::voicesPerCore(double seconds/*=2*/)
+{
+    int frames=static_cast<int>(seconds*m_sampleRate);
+    float left[XFM_RENDER_BLOCK];
+    float right[XFM_RENDER_BLOCK];
+    XFMWorkPool *pool=m_pool;
+
+    m_pool=nullptr;
+    allNotesOff();
+    for (int i=0; i<polyphony(); i++) {
+        noteOn(24+(i*5)%96, 100);
+    }
+
+    auto start=std::chrono::steady_clock::now();
+
+    for (int done=0; done<frames; done+=XFM_RENDER_BLOCK) {
+        render(left, right, XFM_RENDER_BLOCK);
+    }
+
+    double elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    allNotesOff();
+    m_pool=pool;
+
+    return elapsed > 0 ? polyphony()*seconds/elapsed : 0;
+}
+
+// Like voicesPerCore, but through render() in blocks big enough to be
+// worth sharing out
+double XFMRenderer::voicesInRealTime(double seconds/*=2*/)
+{
+    const int block=4096;
+    int frames=static_cast<int>(seconds*m_sampleRate);
+    std::vector<float> left(block);
+    std::vector<float> right(block);
+
+    allNotesOff();
+    for (int i=0; i<polyphony(); i++) {
+        noteOn(24+(i*5)%96, 100);
+    }
+
+    auto start=std::chrono::steady_clock::now();
+
+    for (int done=0; done<frames; done+=block) {
+        render(left.data(), right.data(), block);
+    }
+
+    double elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    allNotesOff();
+
+    return elapsed > 0 ? polyphony()*seconds/elapsed : 0;
+}
+
+void XFMRenderer::renderNote(int note, int velocity, double holdSeconds, double tailSeconds, std::vector<float> &out)
+{
+    int hold=static_cast<int>(holdSeconds*m_sampleRate);
+    int tail=static_cast<int>(tailSeconds*m_sampleRate);
+    float left[XFM_RENDER_BLOCK];
+    float right[XFM_RENDER_BLOCK];
+
+    out.clear();
+    noteOn(note, velocity);
+
+    for (int done=0; done<hold+tail; done+=XFM_RENDER_BLOCK) {
+        int n=(hold+tail-done < XFM_RENDER_BLOCK) ? hold+tail-done : XFM_RENDER_BLOCK;
+
+        if (done >= hold) {
+            noteOff(note);
+            if (!ringing()) {
+                break;
+            }
+        }
+
+        render(left, right, n);
+        for (int i=0; i<n; i++) {
+            out.push_back(left[i]);
+            out.push_back(right[i]);
+        }
+    }
+}
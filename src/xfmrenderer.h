@@ -0,0 +1,292 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMRENDERER_H
+#define XFMRENDERER_H
+
+#include <stdint.h>
+#include <vector>
+#include "xfmeffects.h"
+#include "xfmkernels.h"
+#include "xfmmodsources.h"
+#include "xfmwavetable.h"
+
+class XFMWorkPool;
+struct XFMAlgorithmPlan;
+
+// Samples worked out together.  Envelopes and other control values are
+// updated once per block and ramped across it
+#define XFM_RENDER_BLOCK 64
+
+/*
+ * The parts of a 512 byte patch image the renderer uses, turned into
+ * numbers it can work with directly.  Decoding is done once per patch
+ * rather than once per sample.
+ */
+struct XFMPatchParams {
+    const XFMAlgorithmPlan *plan;       // ALGO1-6, compiled
+    float           feedback[6];        // Self modulation depth, in cycles
+    float           ratio[6];           // Frequency ratio, including fine tune
+    bool            keyTrack[6];        // False for a fixed frequency operator
+    float           gain[6];            // Output level, as an amplitude
+    float           velocitySens[6];    // 0-1
+    float           left[6];            // Carrier output to each side
+    float           right[6];
+    float           envLevel[6][6];     // L0-L5, 0-255
+    float           envTime[6][6];      // R0 (delay) to R5, in seconds (a full scale move for R1-R5)
+    float           volume;             // MASTER_VOLUME
+
+    // How notes are played
+    enum Portamento { Off, Always, Fingered };
+    bool            mono;               // MASTER_LEGATO
+    int             portamento;         // MASTER_PORTAMENTO_MODE
+    float           glideTime;          // MASTER_PORTAMENTO_TIME, in seconds
+    bool            egRestart;          // Legato notes start the envelopes again
+    float           tune;               // MASTER_TRANSPOSE and MASTER_TUNING, in semitones
+
+    // The same again for the fixed point engine
+    int32_t         feedbackQ12[6];     // Feedback depth in cycles, 4.12
+    int32_t         leftQ15[6];         // Carrier output to each side, with the volume
+    int32_t         rightQ15[6];
+
+    // Waveforms.  An operator with its second wave switched on (OP_WMODE bit
+    // 0) gets a table of its own with the two waves already mixed
+    unsigned char   wave[6];            // OP_WAVE1
+    bool            sine[6];            // A plain sine, which the kernels can do without a table
+    bool            blended[6];
+    float           blendTable[6][XFMWaveTables::Size+1];
+    int16_t         blendTableQ15[6][XFMWaveTables::FixedSize];
+
+    XFMModulationParams mod;
+
+    void decode(const unsigned char *image);
+
+    const float *waveTable(int op) const
+    {
+        return blended[op] ? blendTable[op] : XFMWaveTables::wave(wave[op]);
+    }
+
+    const int16_t *waveTableQ15(int op) const
+    {
+        return blended[op] ? blendTableQ15[op] : XFMWaveTables::waveQ15(wave[op]);
+    }
+};
+
+/*
+ * One note being played through a patch.
+ *
+ * Operators are worked out a block at a time, modulators first, so each
+ * operator's inner loop is a straight run over the block the compiler can
+ * vectorise.  An operator that feeds back on itself has to be worked out a
+ * sample at a time, and if the algorithm has a loop between operators the
+ * whole voice is, since each operator then needs the others' last sample.
+ */
+class XFMVoice {
+public:
+    XFMVoice();
+
+    // time is when the note starts, in samples since rendering began
+    void noteOn(const XFMPatchParams &patch, int note, int velocity, float sampleRate, uint64_t time=0);
+    void noteOff();
+    void stop();
+
+    // Move a held note on to another without starting it again, for mono
+    // patches.  With restart the envelopes start over from where they are
+    void legato(const XFMPatchParams &patch, int note, bool restart);
+
+    // Slide from a pitch (a note number, tuning included) to the note
+    // being played, over seconds
+    void glide(float from, float seconds);
+    float pitch() const;
+
+    bool isActive() const;
+    bool isReleased() const;
+    int note() const;
+
+    // Use a particular set of kernels rather than the best one
+    void setKernels(const XFMKernels *kernels);
+
+    // Work in fixed point rather than float.  Takes effect at the next note
+    void setFixedPoint(bool fixed);
+
+    // Add the voice into left and right
+    void render(const XFMPatchParams &patch, const XFMControlFrame &frame, float *left, float *right, int frames);
+
+private:
+    struct Envelope {
+        int     stage;      // 0 delay, 1-4 attack to sustain, 5 sustain, 6 release, 7 finished
+        float   level;      // 0-255
+        int     delay;      // Samples left in the delay stage
+        int32_t levelQ16;   // 0-255 in 8.16, for the fixed point engine
+    };
+
+    void control(const XFMPatchParams &patch, const XFMControlFrame &frame, uint64_t time, int samples);
+    void loop(const XFMPatchParams &patch, int op);
+    float advance(const XFMPatchParams &patch, int op, int samples);
+    void renderBlock(const XFMPatchParams &patch, float *left, float *right, int n);
+    void renderSerial(const XFMPatchParams &patch, float *left, float *right, int n);
+    int32_t advanceFixed(const XFMPatchParams &patch, int op, int samples);
+    void renderFixed(const XFMPatchParams &patch, float *left, float *right, int n);
+
+    bool        m_active;
+    bool        m_released;
+    int         m_note;
+    float       m_sampleRate;
+    float       m_velocity;         // 0-1
+    float       m_phase[6];         // Operator phase in cycles, 0-1
+    float       m_increment[6];     // Cycles per sample
+    float       m_amp[6];           // Amplitude at the end of the last block
+    float       m_last[6][2];       // Each operator's last two samples, for feedback
+    Envelope    m_env[6];
+
+    // Modulation, worked out once a block
+    float       m_pitch;            // The note being played, in semitones
+    float       m_target;           // Where a portamento is going
+    float       m_glide;            // How far it goes each sample
+    float       m_tuned[6];         // The pitch each operator's increment was last worked out for
+    float       m_modGain[6];       // From the LFO and EG bias
+    float       m_detune;           // Random pitch, in semitones
+    float       m_lfoOffset;        // Where a multi free LFO starts, in cycles
+    uint64_t    m_start;            // When the note started
+    uint32_t    m_seed;
+    XFMPitchEnvelope    m_pitchEnv;
+    const XFMKernels *m_kernels;
+
+    // Fixed point state.  Phases are fractions of a cycle in 0.32, so they
+    // wrap by themselves, and samples and amplitudes are 1.15
+    bool        m_fixed;
+    uint32_t    m_phaseQ[6];
+    uint32_t    m_incrementQ[6];
+    int32_t     m_ampQ[6];
+    int32_t     m_gainQ[6];         // Output level with velocity, 1.15
+    int32_t     m_modGainQ[6];
+    int32_t     m_lastQ[6][2];
+    int32_t     m_stepQ[6][6];      // Envelope move per sample for each segment, 8.16
+};
+
+/*
+ * Plays patches without the synth, e.g. to audition or analyse them.
+ *
+ * Load a patch image (in the same format as the edit buffer), play notes
+ * and render the result into a pair of float buffers.
+ *
+ * Given a work pool, render() hands each sounding voice to the pool as a
+ * job of its own.  Every worker adds its voices into a buffer of its own and
+ * the buffers are mixed once they're all done, so the workers never share
+ * anything they write to.  The hand-off costs a few microseconds, so this
+ * pays for itself on blocks of a thousand frames or more, not on 64.
+ *
+ * In Fixed mode voices work the way the synth's FPGA does, with integer
+ * phase accumulators, table lookups for the waveform and levels, and
+ * integer envelopes.  Only the final mix is done in float.  It's the
+ * quicker mode on CPUs with a slow FPU and it's closer to the hardware,
+ * though the float mode is cleaner (its wave tables are 12 bits and aren't
+ * interpolated).
+ */
+class XFMRenderer {
+public:
+    enum { DefaultVoices=16, HeldNotes=16 };
+    enum Mode { Float, Fixed };
+    enum Controller { Wheel, Aftertouch, Breath, Foot };
+
+    explicit XFMRenderer(float sampleRate=48000, int polyphony=DefaultVoices);
+
+    void loadPatch(const unsigned char *image);
+    const XFMPatchParams &patch() const;
+    float sampleRate() const;
+
+    void noteOn(int note, int velocity);
+    void noteOff(int note);
+    void allNotesOff();
+    int activeVoices() const;
+    int polyphony() const;
+
+    // True while there's still something to hear, from a voice or an effect tail
+    bool ringing() const;
+
+    // Controllers are 0-1, the pitch bend -1 to 1
+    void setController(Controller controller, float value);
+    void setPitchBend(float bend);
+
+    // Spread rendering over a pool of threads, or nullptr to render on the
+    // calling thread
+    void setPool(XFMWorkPool *pool);
+    XFMWorkPool *pool() const;
+
+    // Render frames of audio.  left and right are overwritten
+    void render(float *left, float *right, int frames);
+
+    // The pool only ever sees blocks this long, so its buffers are sized
+    // once and rendering never allocates
+    enum { ParallelFrames=4096 };
+
+    // Render with a particular set of kernels, e.g. to compare them
+    void setKernels(const XFMKernels &kernels);
+
+    // Changing mode stops any notes that are playing
+    void setMode(Mode mode);
+    Mode mode() const;
+
+    // Run the output through the patch's effects.  On by default
+    void setEffects(bool on);
+    bool effects() const;
+
+    // How many voices of the loaded patch one core can render in real time
+    double voicesPerCore(double seconds=2);
+
+    // How many voices of the loaded patch the pool can render in real time,
+    // with every voice playing
+    double voicesInRealTime(double seconds=2);
+
+    // Play a single note for holdSeconds, then let it and any effects ring
+    // for up to tailSeconds, into interleaved stereo
+    void renderNote(int note, int velocity, double holdSeconds, double tailSeconds, std::vector<float> &out);
+
+private:
+    int allocate(int note);
+    void hold(int note);
+    void unhold(int note);
+    bool glides(bool held) const;
+    void renderParallel(const XFMControlFrame &frame, float *left, float *right, int frames);
+
+    float           m_sampleRate;
+    XFMPatchParams  m_patch;
+    std::vector<XFMVoice>       m_voices;
+    std::vector<unsigned int>   m_age;      // When each voice was started, for stealing the oldest
+    unsigned int    m_clock;
+    int             m_held[HeldNotes];  // Keys down, oldest first
+    int             m_heldCount;
+    float           m_lastPitch;        // Of the last note played, for portamento
+    bool            m_played;           // Whether there has been a last note
+    XFMControlFrame m_frame;            // Controllers and the time, for the next render
+    Mode            m_mode;
+    XFMEffects      m_effects;
+    bool            m_effectsOn;
+    XFMWorkPool     *m_pool;
+    std::vector<int>    m_sounding;         // Voices handed to the pool this block
+    std::vector<float>  m_scratch;          // Left then right, for each worker
+    std::vector<char>   m_scratchUsed;      // Workers that rendered anything this block
+};
+
+#endif // XFMRENDERER_H
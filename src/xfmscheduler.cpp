@@ -0,0 +1,390 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "xfmscheduler.h"
+#include "xfmdevice.h"
+
+// Default tick and link share
+#define DEFAULTTICK     10
+#define DEFAULTSHARE    50
+
+#define QUEUESIZE       (XFM2_UNITS*512)
+
+XFMParameterScheduler::XFMParameterScheduler(XFMDevice *device, QObject *parent) : QObject(parent)
+{
+    m_device=device;
+    m_share=DEFAULTSHARE;
+    m_head=0;
+    m_count=0;
+    memset(m_waiting, 0, sizeof(m_waiting));
+    memset(m_modulating, 0, sizeof(m_modulating));
+    memset(m_holding, 0xff, sizeof(m_holding));
+    memset(m_gliding, 0, sizeof(m_gliding));
+    memset(m_slew, 0, sizeof(m_slew));
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    for (int i=0; i<512; i++) {
+        m_slewCurve[i]=XFMCurve::Linear;
+    }
+    m_clock.start();
+
+    m_timer=new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(DEFAULTTICK);
+    connect(m_timer, &QTimer::timeout, this, &XFMParameterScheduler::tick);
+}
+
+void XFMParameterScheduler::set(int unit, int offset, unsigned char value)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return;
+    }
+
+    // A slewed parameter glides from wherever the synth has got to
+    if (m_slew[offset] > 0) {
+        unsigned char *buffer=m_device->unit(unit).buffer;
+
+        if (buffer[offset] != value) {
+            unsigned char from=buffer[offset];
+
+            buffer[offset]=value;
+            glide(unit, offset, from);
+        }
+        return;
+    }
+
+    m_target[unit][offset]=value;
+    m_modulating[unit][offset]=false;
+
+    if (!enqueue(unit, offset)) {
+        m_stats.coalesced++;
+    }
+}
+
+// Modulation is smooth already, so slews don't apply, and it takes over
+// from a glide that's under way
+void XFMParameterScheduler::modulate(int unit, int offset, unsigned char value)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return;
+    }
+
+    stopGlide(unit, offset);
+    m_target[unit][offset]=value;
+    m_modulating[unit][offset]=true;
+
+    if (!enqueue(unit, offset)) {
+        m_stats.coalesced++;
+    }
+}
+
+// Add a parameter to the back of the queue.  Returns false if it was already waiting
+bool XFMParameterScheduler::enqueue(int unit, int offset)
+{
+    if (m_waiting[unit][offset]) {
+        return false;
+    }
+
+    m_waiting[unit][offset]=true;
+    m_queue[(m_head+m_count)%QUEUESIZE]=static_cast<unsigned short>(unit*512+offset);
+    m_count++;
+
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+
+    return true;
+}
+
+// The queue entry stays put, but its target becomes whatever the edit
+// buffer holds now, so it costs nothing when it comes up.  The edit is
+// being sent, so the synth won't be holding a modulated value any more
+void XFMParameterScheduler::forget(int unit, int offset)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return;
+    }
+
+    m_holding[unit][offset]=-1;
+
+    if (m_waiting[unit][offset]) {
+        m_target[unit][offset]=m_device->unit(unit).buffer[offset];
+        m_modulating[unit][offset]=false;
+    }
+}
+
+void XFMParameterScheduler::forgetAll()
+{
+    memset(m_waiting, 0, sizeof(m_waiting));
+    memset(m_gliding, 0, sizeof(m_gliding));
+    m_head=0;
+    m_count=0;
+    m_timer->stop();
+}
+
+void XFMParameterScheduler::setTickInterval(int ms)
+{
+    if (ms < 1) ms=1;
+    if (ms > 1000) ms=1000;
+
+    m_timer->setInterval(ms);
+}
+
+int XFMParameterScheduler::tickInterval() const
+{
+    return m_timer->interval();
+}
+
+void XFMParameterScheduler::setShare(int percent)
+{
+    if (percent < 1) percent=1;
+    if (percent > 100) percent=100;
+
+    m_share=percent;
+}
+
+int XFMParameterScheduler::share() const
+{
+    return m_share;
+}
+
+bool XFMParameterScheduler::isIdle() const
+{
+    return m_count == 0;
+}
+
+XFMSchedulerStats XFMParameterScheduler::stats() const
+{
+    return m_stats;
+}
+
+void XFMParameterScheduler::setSlew(int offset, int ms, XFMCurve::Shape curve/*=XFMCurve::Linear*/)
+{
+    if (offset < 0 || offset > 511) {
+        return;
+    }
+
+    if (ms < 0) ms=0;
+    if (ms > 10000) ms=10000;
+
+    m_slew[offset]=static_cast<unsigned short>(ms);
+    m_slewCurve[offset]=curve;
+}
+
+int XFMParameterScheduler::slew(int offset) const
+{
+    return (offset >= 0 && offset < 512) ? m_slew[offset] : 0;
+}
+
+// Glides already running carry on to where they were going
+void XFMParameterScheduler::clearSlews()
+{
+    memset(m_slew, 0, sizeof(m_slew));
+}
+
+void XFMParameterScheduler::glide(int unit, int offset, unsigned char from)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return;
+    }
+
+    XFMGlide &g=m_glides[unit][offset];
+
+    // Changing direction mid glide starts from the value the synth has
+    if (!m_gliding[unit][offset]) {
+        g.sent=from;
+    }
+
+    g.start=m_clock.elapsed();
+    g.length=m_slew[offset] > 0 ? m_slew[offset] : 1;
+    g.from=g.sent;
+    g.to=m_device->unit(unit).buffer[offset];
+
+    m_gliding[unit][offset]=true;
+    m_stats.glides++;
+    enqueue(unit, offset);
+}
+
+// The queue entry stays, but like forget() it now costs nothing
+void XFMParameterScheduler::stopGlide(int unit, int offset)
+{
+    if (m_gliding[unit][offset]) {
+        m_gliding[unit][offset]=false;
+        m_target[unit][offset]=m_device->unit(unit).buffer[offset];
+    }
+}
+
+void XFMParameterScheduler::settle(int unit)
+{
+    bool online=m_device->isConnected() && m_device->unit(unit).initialised;
+    XFMTransport *transport=m_device->transport();
+    const unsigned char *buffer=m_device->unit(unit).buffer;
+
+    transport->hold();
+
+    for (int offset=0; offset<512; offset++) {
+        if (m_holding[unit][offset] >= 0) {
+            if (online) {
+                transport->queueParameter(unit, offset, buffer[offset]);
+            }
+            m_holding[unit][offset]=-1;
+        }
+
+        if (!m_gliding[unit][offset]) {
+            continue;
+        }
+
+        XFMGlide &g=m_glides[unit][offset];
+
+        if (online && g.sent != g.to) {
+            transport->queueParameter(unit, offset, static_cast<unsigned char>(g.to));
+        }
+        g.sent=g.to;
+        stopGlide(unit, offset);
+    }
+
+    transport->release();
+}
+
+void XFMParameterScheduler::tick()
+{
+    // Bytes we can send this tick.  A frame is 3 bytes, or 4 for the upper
+    // half of the parameters, plus a unit select when the unit changes
+    int budget=XFM2_LINK_BYTES_PER_SECOND*m_timer->interval()/1000*m_share/100;
+    int lastUnit=-1;
+    int sent=0;
+
+    if (budget < 5) {
+        budget=5;
+    }
+
+    XFMTransport *transport=m_device->transport();
+    qint64 now=m_clock.elapsed();
+
+    transport->hold();
+
+    // Glides go back in the queue until they arrive, so each entry is looked at once
+    for (int entries=m_count; entries > 0 && m_count > 0; entries--) {
+        int slot=m_queue[m_head];
+        int unit=slot/512;
+        int offset=slot%512;
+
+        if (m_gliding[unit][offset]) {
+            XFMGlide &g=m_glides[unit][offset];
+            double x=(now-g.start >= g.length) ? 1 : (now-g.start)/static_cast<double>(g.length);
+            int v=static_cast<int>(lround(g.from+(g.to-g.from)*XFMCurve::apply(m_slewCurve[offset], x)));
+
+            if (v != g.sent) {
+                int cost=(offset < 256) ? 3 : 4;
+                if (unit != lastUnit) {
+                    cost++;
+                }
+
+                if (cost > budget) {
+                    m_stats.deferred++;
+                    break;
+                }
+
+                if (m_device->isConnected() && m_device->unit(unit).initialised) {
+                    transport->queueParameter(unit, offset, static_cast<unsigned char>(v));
+                }
+                g.sent=v;
+                budget-=cost;
+                lastUnit=unit;
+                sent++;
+            }
+
+            m_head=(m_head+1)%QUEUESIZE;
+            m_count--;
+
+            if (g.sent == g.to && x >= 1) {
+                m_gliding[unit][offset]=false;
+                m_waiting[unit][offset]=false;
+            } else {
+                m_queue[(m_head+m_count)%QUEUESIZE]=static_cast<unsigned short>(slot);
+                m_count++;
+            }
+            continue;
+        }
+
+        unsigned char value=m_target[unit][offset];
+        bool modulating=m_modulating[unit][offset];
+        const unsigned char *buffer=m_device->unit(unit).buffer;
+        int current=(m_holding[unit][offset] >= 0) ? m_holding[unit][offset] : buffer[offset];
+
+        if (current == value && (modulating || buffer[offset] == value)) {
+            // Nothing to send
+            m_head=(m_head+1)%QUEUESIZE;
+            m_count--;
+            m_waiting[unit][offset]=false;
+            continue;
+        }
+
+        int cost=(offset < 256) ? 3 : 4;
+        if (unit != lastUnit) {
+            cost++;
+        }
+
+        if (cost > budget) {
+            m_stats.deferred++;
+            break;
+        }
+
+        m_head=(m_head+1)%QUEUESIZE;
+        m_count--;
+        m_waiting[unit][offset]=false;
+
+        if (modulating) {
+            if (m_device->isConnected() && m_device->unit(unit).initialised) {
+                transport->queueParameter(unit, offset, value);
+                m_holding[unit][offset]=(value == buffer[offset]) ? -1 : value;
+            }
+        } else if (buffer[offset] == value) {
+            // Only the synth is out of step, still holding a modulated value
+            if (m_device->isConnected() && m_device->unit(unit).initialised) {
+                transport->queueParameter(unit, offset, value);
+            }
+            m_holding[unit][offset]=-1;
+        } else {
+            m_holding[unit][offset]=-1;
+            m_device->writeLocation(unit, offset, value, false);
+        }
+        budget-=cost;
+        lastUnit=unit;
+        sent++;
+    }
+
+    transport->release();
+
+    if (sent > 0) {
+        m_stats.ticks++;
+        m_stats.frames+=static_cast<quint64>(sent);
+    }
+
+    if (m_count == 0) {
+        m_timer->stop();
+        emit drained();
+    }
+}
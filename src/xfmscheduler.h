@@ -0,0 +1,157 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMSCHEDULER_H
+#define XFMSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include "xfmcurve.h"
+#include "xfmtransport.h"
+
+class XFMDevice;
+
+// The XFM2 link runs at 500000 baud with 10 bits per byte
+#define XFM2_LINK_BYTES_PER_SECOND 50000
+
+/*
+ * Counters for the scheduler, mostly to see how often the budget bites.
+ */
+struct XFMSchedulerStats {
+    quint64     ticks;          // Ticks that sent something
+    quint64     frames;         // Parameter changes sent
+    quint64     coalesced;      // Changes replaced by a newer value before they were sent
+    quint64     deferred;       // Ticks that ran out of budget with changes still waiting
+    quint64     glides;         // Slewed changes started
+};
+
+/*
+ * A slew in progress.  The edit buffer already holds where it's going, so
+ * what the synth actually has is kept here.
+ */
+struct XFMGlide {
+    qint64      start;          // When the glide started, in ms on the scheduler's clock
+    int         length;         // How long it takes, in ms
+    int         from;
+    int         to;
+    int         sent;           // Value last sent to the synth
+};
+
+/*
+ * A coalescing writer for parameter changes that are generated rather than
+ * typed in: morphs, modulators and the like.
+ *
+ * Producers set a target value for any parameter whenever they like.  A
+ * parameter that is already waiting just has its value replaced, so however
+ * fast the values change only the latest one is ever sent.  Every tick the
+ * waiting parameters are sent, oldest first, in a single write, until the
+ * tick's share of the link has been used up.  Whatever doesn't fit waits
+ * for the next tick, which leaves the rest of the link free for edits made
+ * from the UI.
+ *
+ * The edit buffer is updated as each value is sent but nothing goes into
+ * the undo history.  Modulated values are the exception: they only go to
+ * the synth, and the edit buffer keeps the value they swing around, so
+ * that's what gets stored, compared and undone.  The timer only runs while
+ * there's something waiting.
+ *
+ * Parameters can also be given a slew time and curve.  A change to one of
+ * those, whether it comes from a producer or is edited by hand, glides
+ * there instead of jumping: the edit buffer takes the new value straight
+ * away and each tick sends the value part way along the curve.  Glides
+ * share the queue and the budget with everything else, so a fast sweep
+ * sounds smooth without sending any more than one value per parameter
+ * per tick.
+ */
+class XFMParameterScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    explicit XFMParameterScheduler(XFMDevice *device, QObject *parent = nullptr);
+
+    // Set the value a parameter should end up at
+    void set(int unit, int offset, unsigned char value);
+
+    // Send a modulated value to the synth, leaving the edit buffer alone
+    void modulate(int unit, int offset, unsigned char value);
+
+    // Drop a waiting change, e.g. because the parameter was edited by hand
+    void forget(int unit, int offset);
+    void forgetAll();
+
+    // How often to send, in milliseconds
+    void setTickInterval(int ms);
+    int tickInterval() const;
+
+    // The percentage of the link the scheduler may use each tick
+    void setShare(int percent);
+    int share() const;
+
+    bool isIdle() const;
+    XFMSchedulerStats stats() const;
+
+    // Slew a parameter (on every unit) over ms milliseconds.  0 turns it off
+    void setSlew(int offset, int ms, XFMCurve::Shape curve=XFMCurve::Linear);
+    int slew(int offset) const;
+    void clearSlews();
+
+    // Glide a parameter from the value the synth has now to the one in the edit buffer
+    void glide(int unit, int offset, unsigned char from);
+
+    // Drop a glide because the parameter is about to be sent directly
+    void stopGlide(int unit, int offset);
+
+    // Finish every glide on a unit straight away, and put modulated parameters
+    // back to the edit buffer's values, so the synth matches the edit buffer
+    void settle(int unit);
+
+signals:
+    // Everything that was waiting has been sent
+    void drained();
+
+private slots:
+    void tick();
+
+private:
+    bool enqueue(int unit, int offset);
+
+    XFMDevice *         m_device;
+    QTimer *            m_timer;
+    int                 m_share;                        // Percentage of the link we may use
+    unsigned char       m_target[XFM2_UNITS][512];      // Latest value for each waiting parameter
+    bool                m_waiting[XFM2_UNITS][512];     // True if the parameter is in the queue
+    bool                m_modulating[XFM2_UNITS][512];  // True if the waiting value is from modulate()
+    short               m_holding[XFM2_UNITS][512];     // Modulated value the synth has instead of the edit buffer's, or -1
+    unsigned short      m_queue[XFM2_UNITS*512];        // Waiting parameters (unit*512+offset), oldest first
+    int                 m_head;                         // Oldest entry in m_queue
+    int                 m_count;                        // Entries in m_queue
+    unsigned short      m_slew[512];                    // Slew time for each parameter, in ms
+    XFMCurve::Shape     m_slewCurve[512];
+    bool                m_gliding[XFM2_UNITS][512];     // True if the queue entry is a glide
+    XFMGlide            m_glides[XFM2_UNITS][512];
+    QElapsedTimer       m_clock;
+    XFMSchedulerStats   m_stats;
+};
+
+#endif // XFMSCHEDULER_H
@@ -0,0 +1,280 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "xfmsequencer.h"
+#include "xfmclock.h"
+#include "xfmdevice.h"
+#include "xfm2.h"
+
+#define DEFAULTTEMPO 120.0
+
+XFMSequencer::XFMSequencer(XFMDevice *device, QObject *parent) : QThread(parent)
+{
+    m_device=device;
+    m_transport=device->transport();
+    m_trackCount=0;
+    m_length=16;
+    m_tempo=DEFAULTTEMPO;
+    m_tempoLock=false;
+    m_stop=false;
+    m_played=0;
+    m_maxLate=0;
+    m_totalLate=0;
+    m_maxJitter=0;
+
+    memset(m_locks, 0xff, sizeof(m_locks));
+    updateStepLength();
+
+    connect(this, &QThread::finished, this, &XFMSequencer::playbackFinished);
+}
+
+XFMSequencer::~XFMSequencer()
+{
+    m_stop=true;
+    wait();
+}
+
+int XFMSequencer::addTrack(int unit, int offset)
+{
+    if (unit < 0 || unit >= XFM2_UNITS || offset < 0 || offset > 511) {
+        return -1;
+    }
+
+    QMutexLocker locker(&m_lock);
+
+    if (m_trackCount == MaxTracks) {
+        return -1;
+    }
+
+    Track &t=m_tracks[m_trackCount];
+
+    t.unit=unit;
+    t.offset=offset;
+    t.base=m_device->unit(unit).buffer[offset];
+
+    return m_trackCount++;
+}
+
+int XFMSequencer::trackCount() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_trackCount;
+}
+
+bool XFMSequencer::setLock(int step, int track, int value)
+{
+    QMutexLocker locker(&m_lock);
+
+    if (step < 0 || step >= MaxSteps || track < 0 || track >= m_trackCount || value > 255) {
+        return false;
+    }
+
+    m_locks[step][track]=static_cast<short>(value < 0 ? -1 : value);
+    return true;
+}
+
+void XFMSequencer::setLength(int steps)
+{
+    if (steps < 1) steps=1;
+    if (steps > MaxSteps) steps=MaxSteps;
+
+    QMutexLocker locker(&m_lock);
+    m_length=steps;
+}
+
+int XFMSequencer::length() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_length;
+}
+
+void XFMSequencer::setTempo(double bpm)
+{
+    if (bpm < 20) bpm=20;
+    if (bpm > 300) bpm=300;
+
+    m_tempo=bpm;
+    updateStepLength();
+}
+
+double XFMSequencer::tempo() const
+{
+    return m_tempo;
+}
+
+void XFMSequencer::setTempoLock(bool locked)
+{
+    m_tempoLock=locked;
+    updateStepLength();
+}
+
+bool XFMSequencer::tempoLock() const
+{
+    return m_tempoLock;
+}
+
+void XFMSequencer::syncTempo()
+{
+    if (m_tempoLock) {
+        updateStepLength();
+    }
+}
+
+void XFMSequencer::updateStepLength()
+{
+    double bpm=m_tempo;
+
+    if (m_tempoLock) {
+        int arp=m_device->unit(m_device->activeUnit()).buffer[ARPEGGIATOR_TEMPO];
+
+        if (arp > 0) {
+            bpm=arp;
+        }
+    }
+
+    m_stepNs=static_cast<qint64>(60.0e9/bpm/StepsPerBeat);
+}
+
+void XFMSequencer::clear()
+{
+    stop();
+
+    QMutexLocker locker(&m_lock);
+    m_trackCount=0;
+    memset(m_locks, 0xff, sizeof(m_locks));
+}
+
+bool XFMSequencer::play()
+{
+    stop();
+
+    if (trackCount() == 0) {
+        return false;
+    }
+
+    m_stop=false;
+    m_played=0;
+    m_maxLate=0;
+    m_totalLate=0;
+    m_maxJitter=0;
+
+    m_device->beginLanding();
+    start(QThread::TimeCriticalPriority);
+    return true;
+}
+
+void XFMSequencer::stop()
+{
+    if (isRunning()) {
+        m_stop=true;
+        wait();
+    }
+}
+
+bool XFMSequencer::isPlaying() const
+{
+    return isRunning();
+}
+
+XFMSequencerStats XFMSequencer::stats() const
+{
+    XFMSequencerStats s;
+    quint64 steps=m_played;
+
+    s.steps=steps;
+    s.maxLateNs=m_maxLate;
+    s.meanLateNs=steps ? m_totalLate/static_cast<qint64>(steps) : 0;
+    s.maxJitterNs=m_maxJitter;
+
+    return s;
+}
+
+// Put every track back to its base value
+void XFMSequencer::playbackFinished()
+{
+    m_device->endLanding();
+
+    QMutexLocker locker(&m_lock);
+
+    m_transport->hold();
+    for (int t=0; t<m_trackCount; t++) {
+        m_device->writeLocation(m_tracks[t].unit, m_tracks[t].offset, m_tracks[t].base, false);
+    }
+    m_transport->release();
+}
+
+void XFMSequencer::run()
+{
+    short sent[MaxTracks];
+    int step=0;
+    qint64 deadline=XFMClock::now();
+    qint64 lastLate=0;
+
+    // Nothing has been sent yet, so the first step sends every track
+    memset(sent, 0xff, sizeof(sent));
+
+    while (!m_stop) {
+        if (!XFMClock::sleepUntil(deadline, &m_stop)) {
+            break;
+        }
+
+        qint64 late=XFMClock::now()-deadline;
+
+        m_lock.lock();
+
+        m_transport->hold();
+        for (int t=0; t<m_trackCount; t++) {
+            short v=m_locks[step][t];
+
+            if (v < 0) {
+                v=m_tracks[t].base;
+            }
+
+            if (v != sent[t]) {
+                m_transport->queueParameter(m_tracks[t].unit, m_tracks[t].offset, static_cast<unsigned char>(v));
+                m_device->land(m_tracks[t].unit, m_tracks[t].offset, static_cast<unsigned char>(v));
+                sent[t]=v;
+            }
+        }
+        m_transport->release();
+
+        step=(step+1)%m_length;
+        m_lock.unlock();
+
+        qint64 jitter=late > lastLate ? late-lastLate : lastLate-late;
+
+        if (m_played > 0 && jitter > m_maxJitter) {
+            m_maxJitter=jitter;
+        }
+        if (late > m_maxLate) {
+            m_maxLate=late;
+        }
+        m_totalLate+=late;
+        m_played++;
+        lastLate=late;
+
+        // Deadlines are absolute, so lateness never builds up
+        deadline+=m_stepNs;
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMSEQUENCER_H
+#define XFMSEQUENCER_H
+
+#include <QMutex>
+#include <QThread>
+#include <atomic>
+#include "xfmtransport.h"
+
+class XFMDevice;
+
+/*
+ * Step timing.  Lateness is how far past its deadline each step actually
+ * went to the transport, and jitter is how much that changed from one step
+ * to the next.
+ */
+struct XFMSequencerStats {
+    quint64     steps;          // Steps played
+    qint64      maxLateNs;
+    qint64      meanLateNs;
+    qint64      maxJitterNs;
+};
+
+/*
+ * A parameter step sequencer.
+ *
+ * Each track drives one parameter, and each step can lock a track to a
+ * value.  Steps without a lock put the track back to the value it had when
+ * it was added, so a lock only lasts for its own step.  Playback runs on a
+ * time critical thread that waits for each step with XFMClock::sleepUntil
+ * and sends only the tracks whose value changes, all in one write.
+ *
+ * The tempo is either set directly or follows the arpeggiator
+ * (ARPEGGIATOR_TEMPO, which is in BPM with 0 meaning MIDI clock, in which
+ * case the sequencer's own tempo is used).  Steps are sixteenth notes.
+ */
+class XFMSequencer : public QThread {
+    Q_OBJECT
+
+public:
+    enum { MaxSteps=64, MaxTracks=16, StepsPerBeat=4 };
+
+    explicit XFMSequencer(XFMDevice *device, QObject *parent = nullptr);
+    ~XFMSequencer() override;
+
+    // Add a track for a parameter.  Returns the track number, or -1 if there's no room
+    int addTrack(int unit, int offset);
+    int trackCount() const;
+
+    // Lock a track to value on a step, or clear the lock if value is negative
+    bool setLock(int step, int track, int value);
+
+    void setLength(int steps);
+    int length() const;
+
+    void setTempo(double bpm);
+    double tempo() const;
+
+    // Follow the arpeggiator's tempo.  syncTempo() has to be called (on the
+    // GUI thread) when ARPEGGIATOR_TEMPO changes
+    void setTempoLock(bool locked);
+    bool tempoLock() const;
+    void syncTempo();
+
+    // Remove every track and lock
+    void clear();
+
+    bool play();
+    void stop();
+    bool isPlaying() const;
+
+    XFMSequencerStats stats() const;
+
+protected:
+    void run() override;
+
+private slots:
+    void playbackFinished();
+
+private:
+    struct Track {
+        int             unit;
+        int             offset;
+        unsigned char   base;       // Value when there's no lock
+    };
+
+    void updateStepLength();
+
+    XFMDevice *                 m_device;
+    XFMTransport *              m_transport;
+
+    // Pattern, protected by m_lock since it can be edited while playing
+    mutable QMutex              m_lock;
+    Track                       m_tracks[MaxTracks];
+    short                       m_locks[MaxSteps][MaxTracks];   // -1 where there's no lock
+    int                         m_trackCount;
+    int                         m_length;
+
+    double                      m_tempo;            // Our own tempo in BPM
+    bool                        m_tempoLock;
+    std::atomic<qint64>         m_stepNs;           // Length of a step, read by the playback thread
+    std::atomic<bool>           m_stop;
+
+    // Written by the playback thread
+    std::atomic<quint64>        m_played;
+    std::atomic<qint64>         m_maxLate;
+    std::atomic<qint64>         m_totalLate;
+    std::atomic<qint64>         m_maxJitter;
+};
+
+#endif // XFMSEQUENCER_H
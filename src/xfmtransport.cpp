@@ -0,0 +1,498 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <string.h>
+#include "xfmtransport.h"
+
+// How long to wait for the synth to reply to a command, in milliseconds
+#define REPLYTIMEOUT 2000
+
+#ifdef XFM2_COUNT_ALLOCATIONS
+/*
+ * Debug builds can count every heap allocation made by the app.  The count is
+ * kept per thread, and the transport samples it around its own work, which
+ * proves that queueing and flushing parameter changes doesn't allocate.
+ */
+#include <cstdlib>
+#include <new>
+
+static thread_local quint64 t_allocations=0;
+
+void *operator new(size_t size)
+{
+    t_allocations++;
+    void *p=malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static quint64 allocationCount()
+{
+    return t_allocations;
+}
+#else
+static quint64 allocationCount()
+{
+    return 0;
+}
+#endif
+
+XFMTransport::XFMTransport(QObject *parent) : QThread(parent)
+{
+    m_port=nullptr;
+    m_holdCount=0;
+    m_linkUnit=-1;
+    m_open=false;
+    m_stop=false;
+    m_dumping=false;
+    m_request=nullptr;
+    memset(&m_callerStats, 0, sizeof(m_callerStats));
+    memset(&m_threadStats, 0, sizeof(m_threadStats));
+}
+
+XFMTransport::~XFMTransport()
+{
+    m_lock.lock();
+    m_stop=true;
+    m_wake.wakeOne();
+    m_lock.unlock();
+
+    wait();
+}
+
+bool XFMTransport::open(const QString &portName)
+{
+    if (!isRunning()) {
+        start();
+    }
+
+    m_stageLock.lock();
+    m_staging.clear();
+    m_linkUnit=-1;
+
+    m_lock.lock();
+    m_portName=portName;
+    m_outgoing.clear();
+    m_lock.unlock();
+
+    Request request;
+
+    submit(request, OpenRequest, nullptr, 0, nullptr, 0);
+    m_stageLock.unlock();
+
+    return complete(request);
+}
+
+void XFMTransport::close()
+{
+    m_stageLock.lock();
+    m_staging.clear();
+
+    if (!isRunning()) {
+        m_stageLock.unlock();
+        return;
+    }
+
+    Request request;
+
+    submit(request, CloseRequest, nullptr, 0, nullptr, 0);
+    m_stageLock.unlock();
+
+    complete(request);
+}
+
+bool XFMTransport::isOpen() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_open;
+}
+
+QString XFMTransport::portName() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_portName;
+}
+
+XFMTransportStats XFMTransport::stats() const
+{
+    QMutexLocker stageLocker(&m_stageLock);
+    QMutexLocker locker(&m_lock);
+    XFMTransportStats s=m_threadStats;
+
+    s.frames+=m_callerStats.frames;
+    s.allocations+=m_callerStats.allocations;
+
+    return s;
+}
+
+// Queue the unit select command ('$' for unit 1, '%' for unit 2) if the
+// synth isn't already talking to the unit
+bool XFMTransport::selectUnit(int unit)
+{
+    if (unit == m_linkUnit) {
+        return true;
+    }
+
+    const unsigned char select=(unit == 0) ? '$' : '%';
+
+    if (!m_staging.put(&select, 1)) {
+        return false;
+    }
+
+    m_linkUnit=unit;
+    return true;
+}
+
+void XFMTransport::queueParameter(int unit, int offset, unsigned char data)
+{
+    QMutexLocker stageLocker(&m_stageLock);
+    quint64 allocs=allocationCount();
+
+    if (m_staging.space() < 5) {
+        // Make room for a unit select plus the longest frame
+        flushStaged();
+    }
+
+    selectUnit(unit);
+    m_staging.putSetFrame(offset, data);
+    m_callerStats.frames++;
+
+    if (m_holdCount == 0) {
+        flushStaged();
+    }
+
+    m_callerStats.allocations+=allocationCount()-allocs;
+}
+
+void XFMTransport::hold()
+{
+    QMutexLocker stageLocker(&m_stageLock);
+    m_holdCount++;
+}
+
+void XFMTransport::release()
+{
+    QMutexLocker stageLocker(&m_stageLock);
+
+    if (m_holdCount > 0) {
+        m_holdCount--;
+    }
+
+    if (m_holdCount == 0) {
+        flushStaged();
+    }
+}
+
+bool XFMTransport::flush()
+{
+    QMutexLocker stageLocker(&m_stageLock);
+    return flushStaged();
+}
+
+// Hand the staged frames to the transport thread in one piece.
+// If the thread is still busy with an earlier batch we wait for it to make room
+bool XFMTransport::flushStaged()
+{
+    if (m_staging.pending() == 0) {
+        return true;
+    }
+
+    QMutexLocker locker(&m_lock);
+
+    while (m_open && !m_outgoing.take(m_staging)) {
+        m_drained.wait(&m_lock);
+    }
+
+    if (!m_open) {
+        m_staging.clear();
+        return false;
+    }
+
+    m_wake.wakeOne();
+    return true;
+}
+
+bool XFMTransport::command(int unit, const unsigned char *cmd, int len, unsigned char *reply, int replylen)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    Request request;
+
+    // The unit select rides along with any pending frames
+    m_stageLock.lock();
+    selectUnit(unit);
+    flushStaged();
+    submit(request, CommandRequest, cmd, len, reply, replylen);
+    m_stageLock.unlock();
+
+    return complete(request);
+}
+
+// A dump that was never waited for is collected first, so m_bankDump is
+// free before it's posted again
+void XFMTransport::startBankDump(int unit, unsigned char *programs)
+{
+    QMutexLocker stageLocker(&m_stageLock);
+
+    if (m_dumping) {
+        complete(m_bankDump);
+    }
+
+    selectUnit(unit);
+    flushStaged();
+    submit(m_bankDump, BankDumpRequest, nullptr, 0, programs, 128*512);
+    m_dumping=true;
+}
+
+bool XFMTransport::waitForBankDump()
+{
+    m_stageLock.lock();
+    bool dumping=m_dumping;
+    m_dumping=false;
+    m_stageLock.unlock();
+
+    if (!dumping) {
+        return false;
+    }
+
+    return complete(m_bankDump);
+}
+
+// Post a request to the transport thread, after waiting for any request
+// that's already there to finish.  Requests other than open fail straight
+// away if the port isn't open, but still complete so the caller never hangs
+void XFMTransport::submit(Request &request, RequestType type, const unsigned char *cmd, int len, unsigned char *reply, int replylen)
+{
+    QMutexLocker locker(&m_lock);
+
+    while (m_request != nullptr) {
+        m_idle.wait(&m_lock);
+    }
+
+    request.type=type;
+    request.cmd=cmd;
+    request.len=len;
+    request.reply=reply;
+    request.replylen=replylen;
+    request.fence=m_outgoing.pending();
+    request.result=false;
+
+    if (!m_open && type != OpenRequest && type != CloseRequest) {
+        request.done.release();
+        return;
+    }
+
+    m_request=&request;
+    m_wake.wakeOne();
+}
+
+bool XFMTransport::complete(Request &request)
+{
+    request.done.acquire();
+
+    QMutexLocker locker(&m_lock);
+    return request.result;
+}
+
+/*
+ * The transport thread.  It sleeps until there are frames to send or a
+ * request to run.  Frames always go out before the request that follows
+ * them, which keeps everything in the order the caller issued it.
+ */
+void XFMTransport::run()
+{
+    m_port=new QSerialPort();
+    m_port->setBaudRate(500000);
+    m_port->setDataBits(QSerialPort::Data8);
+    m_port->setStopBits(QSerialPort::StopBits::OneStop);
+    m_port->setParity(QSerialPort::Parity::NoParity);
+
+    m_lock.lock();
+
+    while (!m_stop) {
+        if (m_outgoing.pending() == 0 && m_request == nullptr) {
+            m_wake.wait(&m_lock);
+            continue;
+        }
+
+        // Only frames queued before a request go out ahead of it
+        Request *request=m_request;
+        RequestType type=(request != nullptr) ? request->type : NoRequest;
+        int n=m_outgoing.drain(m_flushBuffer, request != nullptr ? request->fence : XFMFrameRing::Capacity);
+
+        m_drained.wakeAll();
+        m_lock.unlock();
+
+        if (n > 0) {
+            writeFrames(n);
+        }
+
+        bool result=false;
+
+        switch (type) {
+            case OpenRequest:
+                if (m_port->isOpen()) {
+                    m_port->close();
+                }
+                m_port->clearError();
+                m_port->setPortName(portName());
+                result=m_port->open(QIODevice::ReadWrite);
+                break;
+
+            case CloseRequest:
+                m_port->close();
+                result=true;
+                break;
+
+            case CommandRequest:
+                result=transact(request->cmd, request->len, request->reply, request->replylen);
+                break;
+
+            case BankDumpRequest:
+                result=dumpBank(request->reply);
+                break;
+
+            default:
+                break;
+        }
+
+        // A resource error means the synth has been unplugged
+        if (m_port->isOpen() && m_port->error() == QSerialPort::ResourceError) {
+            qDebug() << "Lost connection to" << m_port->portName();
+            m_port->close();
+        }
+
+        m_lock.lock();
+        m_open=m_port->isOpen();
+
+        // The caller may free the request as soon as it's released
+        if (request != nullptr) {
+            request->result=result;
+            m_request=nullptr;
+            request->done.release();
+            m_idle.wakeAll();
+        }
+    }
+
+    // Nothing is going to run a request that's still waiting
+    if (m_request != nullptr) {
+        m_request->done.release();
+        m_request=nullptr;
+    }
+
+    m_open=false;
+    m_drained.wakeAll();
+    m_idle.wakeAll();
+    m_lock.unlock();
+
+    delete m_port;
+    m_port=nullptr;
+}
+
+void XFMTransport::writeFrames(int n)
+{
+    if (!m_port->isOpen()) {
+        return;
+    }
+
+    quint64 allocs=allocationCount();
+
+    m_port->write(m_flushBuffer, n);
+    m_port->waitForBytesWritten();
+
+    QMutexLocker locker(&m_lock);
+    m_threadStats.flushes++;
+    m_threadStats.bytes+=static_cast<quint64>(n);
+    m_threadStats.allocations+=allocationCount()-allocs;
+}
+
+bool XFMTransport::transact(const unsigned char *cmd, int len, unsigned char *reply, int replylen)
+{
+    if (!m_port->isOpen()) {
+        return false;
+    }
+
+    m_port->clear();
+    m_port->write(reinterpret_cast<const char *>(cmd), len);
+    m_port->waitForBytesWritten();
+
+    m_lock.lock();
+    m_threadStats.flushes++;
+    m_threadStats.bytes+=static_cast<quint64>(len);
+    m_lock.unlock();
+
+    qint64 bytesread=0;
+
+    while (bytesread < replylen) {
+        if (m_port->bytesAvailable() == 0 && !m_port->waitForReadyRead(REPLYTIMEOUT)) {
+            qDebug() << "Timed out waiting for the synth to reply";
+            return false;
+        }
+
+        qint64 avail=m_port->bytesAvailable();
+
+        if (bytesread+avail > replylen) {
+            avail=replylen-bytesread;
+        }
+
+        bytesread+=m_port->read(reinterpret_cast<char *>(&reply[bytesread]), avail);
+    }
+
+    return true;
+}
+
+// Recall and dump each stored program in turn
+bool XFMTransport::dumpBank(unsigned char *programs)
+{
+    for (int p=0; p<128; p++) {
+        unsigned char bf[2];
+
+        bf[0]='r';
+        bf[1]=static_cast<unsigned char>(p);
+        if (!transact(bf, 2, bf, 1)) {
+            return false;
+        }
+
+        bf[0]='d';
+        if (!transact(bf, 1, &programs[p*512], 512)) {
+            return false;
+        }
+    }
+
+    return true;
+}
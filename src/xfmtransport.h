@@ -0,0 +1,168 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMTRANSPORT_H
+#define XFMTRANSPORT_H
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+#include <QtSerialPort/QSerialPort>
+#include "xfmframering.h"
+
+// The XFM2 is bi-timbral.  Each unit has its own edit buffer
+#define XFM2_UNITS 2
+
+/*
+ * Counters for the serial transport.  Allocations are only counted when
+ * the app is built with XFM2_COUNT_ALLOCATIONS (see xfm2.pro), otherwise
+ * they stay at zero.
+ */
+struct XFMTransportStats {
+    quint64     frames;         // Parameter frames encoded
+    quint64     flushes;        // Writes issued to the serial port
+    quint64     bytes;          // Bytes written
+    quint64     allocations;    // Heap allocations made while queueing and flushing frames
+};
+
+/*
+ * The transport owns the serial port connection to one synth, and runs
+ * it on a thread of its own so several synths can be driven at once.
+ *
+ * Parameter changes are encoded as frames into a fixed staging ring on
+ * the caller's side.  Flushing moves the staged frames across to the
+ * transport thread in one go, and the thread sends everything it has with
+ * a single write.  By default every change is flushed straight away, but
+ * callers that make a lot of changes in one go (e.g. updating a whole
+ * operator) can hold the transport so they all leave in a single write.
+ *
+ * Commands that expect a reply (dump, get, read program etc) are run on
+ * the transport thread after any pending frames, so the synth sees
+ * everything in order.  command() blocks until the reply arrives, while
+ * startBankDump() lets the caller dump several synths in parallel.  The
+ * thread runs one request at a time, and a request made while another is
+ * running (say a command during a bank dump) waits its turn.
+ *
+ * Every frame and command is addressed to one of the XFM2's units.  The
+ * transport remembers which unit the synth currently has selected and only
+ * inserts a unit select byte when the traffic switches units, so edits to
+ * both units can be interleaved on the one link at almost no extra cost.
+ *
+ * Parameter changes may be queued from any thread (e.g. automation playback
+ * runs on a thread of its own), since the staging ring has its own lock.
+ * Each request remembers how many bytes were queued ahead of it, so frames
+ * queued by another thread while it's waiting go out after it.  Commands,
+ * open and close are meant to be called from the thread that owns the
+ * transport (normally the GUI thread), one at a time.
+ */
+class XFMTransport : public QThread {
+    Q_OBJECT
+
+public:
+    explicit XFMTransport(QObject *parent = nullptr);
+    ~XFMTransport() override;
+
+    bool open(const QString &portName);
+    void close();
+    bool isOpen() const;
+    QString portName() const;
+
+    // Queue a parameter change for a unit.  Flushed immediately unless the transport is held
+    void queueParameter(int unit, int offset, unsigned char data);
+
+    // Hold and release are counted, so they may be nested.
+    // The final release flushes everything that was queued
+    void hold();
+    void release();
+
+    bool flush();
+
+    // Send a command to a unit and wait for replylen bytes to come back
+    bool command(int unit, const unsigned char *cmd, int len, unsigned char *reply, int replylen);
+
+    // Read all 128 stored programs into programs (128*512 bytes) in the background.
+    // Recalling each program overwrites the unit's edit buffer, so the caller
+    // needs to restore it afterwards.  The wait may be made from any thread
+    void startBankDump(int unit, unsigned char *programs);
+    bool waitForBankDump();
+
+    XFMTransportStats stats() const;
+
+protected:
+    void run() override;
+
+private:
+    enum RequestType { NoRequest, OpenRequest, CloseRequest, CommandRequest, BankDumpRequest };
+
+    // A job for the transport thread, owned by the caller until it's done
+    struct Request {
+        RequestType             type;
+        const unsigned char *   cmd;
+        int                     len;
+        unsigned char *         reply;
+        int                     replylen;
+        int                     fence;      // Bytes in m_outgoing that go out before the request
+        bool                    result;
+        QSemaphore              done;       // Released once the thread has finished with the request
+    };
+
+    bool selectUnit(int unit);
+    bool flushStaged();
+    void submit(Request &request, RequestType type, const unsigned char *cmd, int len, unsigned char *reply, int replylen);
+    bool complete(Request &request);
+
+    // Transport thread only
+    bool transact(const unsigned char *cmd, int len, unsigned char *reply, int replylen);
+    bool dumpBank(unsigned char *programs);
+    void writeFrames(int n);
+
+    QSerialPort *       m_port;                             // USB serial port connection, owned by the transport thread
+    QString             m_portName;
+
+    // Caller side, protected by m_stageLock (taken before m_lock)
+    mutable QMutex      m_stageLock;
+    XFMFrameRing        m_staging;                          // Frames encoded since the last flush
+    int                 m_holdCount;                        // Flushing is deferred while this is non-zero
+    int                 m_linkUnit;                         // Unit the synth has selected, or -1 if unknown
+    XFMTransportStats   m_callerStats;                      // Frames and allocations counted on the caller side
+    Request             m_bankDump;                         // The dump started by startBankDump()
+    bool                m_dumping;                          // True until waitForBankDump() has collected m_bankDump
+
+    // Shared with the transport thread, protected by m_lock
+    mutable QMutex      m_lock;
+    QWaitCondition      m_wake;                             // Signals the thread that there's work to do
+    QWaitCondition      m_drained;                          // Signals the caller that m_outgoing has room
+    QWaitCondition      m_idle;                             // Signals callers that the thread can take another request
+    XFMFrameRing        m_outgoing;                         // Frames handed over to the thread
+    Request *           m_request;                          // The request waiting for or being run by the thread
+    bool                m_open;
+    bool                m_stop;
+    XFMTransportStats   m_threadStats;                      // Writes and allocations counted by the transport thread
+
+    char                m_flushBuffer[XFMFrameRing::Capacity];  // Flat copy of the ring for a single write
+};
+
+#endif // XFMTRANSPORT_H
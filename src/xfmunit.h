@@ -0,0 +1,60 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFMUNIT_H
+#define XFMUNIT_H
+
+#include <string>
+
+/*
+ * State held for each of the XFM2's units.  Keeping a copy per unit
+ * means the UI can flip between units (for layered and split setups)
+ * without reading anything back from the synth.
+ */
+struct XFMUnit {
+    unsigned char   buffer[512];    // Copy of the unit's edit buffer
+    int             patchnumber;    // Program loaded into the unit
+    bool            initialised;    // True once the edit buffer has been read
+    std::string     patchName;      // Name of the program being edited
+
+    // A/B compare.  buffer always holds what the synth is playing, and
+    // other holds the side that isn't being heard
+    unsigned char   other[512];     // The other side of the comparison
+    bool            comparing;      // True while a comparison is running
+    bool            showingB;       // True if the synth is playing the B side
+};
+
+/*
+ * The stored programs are shared by both units, so there's one cache
+ * for the whole synth.  A program is cached the first time it's loaded
+ * and kept up to date whenever we write it, so recalling it again only
+ * costs the 'r' command.  Programs written while the synth is unplugged
+ * are marked dirty and stored when it comes back.
+ */
+struct XFMBankCache {
+    unsigned char   programs[128][512];
+    bool            valid[128];
+    bool            dirty[128];
+};
+
+#endif // XFMUNIT_H
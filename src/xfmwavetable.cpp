@@ -0,0 +1,148 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xfmwavetable.h"
+
+namespace {
+
+// sin(t) for the compiler, as a Taylor series.  Only used on 0 to pi/2,
+// where ten terms are plenty
+constexpr double taylorSine(double t)
+{
+    double term=t;
+    double sum=t;
+
+    for (int k=1; k<10; k++) {
+        term*=-t*t/((2*k)*(2*k+1));
+        sum+=term;
+    }
+
+    return sum;
+}
+
+/*
+ * Every wave is made from one cycle of sine, which is itself made from a
+ * quarter cycle, so the series is only worked out a thousand or so times.
+ * Filling the tables is still more constexpr work than clang and MSVC
+ * allow by default, so xfm2.pro raises their limits.  Phases are in
+ * 1/FixedSize of a cycle; the float tables use every other one.
+ */
+const int Quarter=XFMWaveTables::FixedSize/4;
+const int Mask=XFMWaveTables::FixedSize-1;
+
+constexpr double waveform(const double *sine, int w, int j)
+{
+    bool first=j < 2*Quarter;
+    double twice=sine[(2*j) & Mask];
+
+    switch (w) {
+        case 1:
+            return first ? sine[j] : 0;
+        case 2:
+            return sine[j] < 0 ? -sine[j] : sine[j];
+        case 3:
+            return (j & Quarter) == 0 ? (sine[j] < 0 ? -sine[j] : sine[j]) : 0;
+        case 4:
+            return first ? twice : 0;
+        case 5:
+            return first ? (twice < 0 ? -twice : twice) : 0;
+        case 6:
+            return first ? 1 : -1;
+        case 7:
+            return first ? j/(2.0*Quarter) : j/(2.0*Quarter)-2;
+        default:
+            return sine[j];
+    }
+}
+
+struct Tables {
+    alignas(64) float       wave[XFMWaveTables::Waves][XFMWaveTables::Size+1];
+    alignas(64) int16_t     waveQ15[XFMWaveTables::Waves][XFMWaveTables::FixedSize];
+
+    constexpr Tables() : wave(), waveQ15()
+    {
+        double sine[XFMWaveTables::FixedSize]={};
+
+        for (int j=0; j<=Quarter; j++) {
+            double v=taylorSine(1.5707963267948966*j/Quarter);
+
+            sine[j]=v;
+            sine[2*Quarter-j]=v;
+            sine[(2*Quarter+j) & Mask]=-v;
+            sine[(4*Quarter-j) & Mask]=-v;
+        }
+
+        for (int w=0; w<XFMWaveTables::Waves; w++) {
+            for (int j=0; j<XFMWaveTables::FixedSize; j++) {
+                double v=waveform(sine, w, j);
+
+                waveQ15[w][j]=static_cast<int16_t>(v < 0 ? 32767*v-0.5 : 32767*v+0.5);
+                if ((j & 1) == 0) {
+                    wave[w][j/2]=static_cast<float>(v);
+                }
+            }
+            wave[w][XFMWaveTables::Size]=wave[w][0];
+        }
+    }
+};
+
+constexpr Tables tables;
+
+}
+
+const float *XFMWaveTables::wave(int w)
+{
+    return tables.wave[w & (Waves-1)];
+}
+
+const int16_t *XFMWaveTables::waveQ15(int w)
+{
+    return tables.waveQ15[w & (Waves-1)];
+}
+
+/*
+ * With the second wave at a whole number ratio the blend repeats every
+ * cycle of the first, so it can be worked out once per patch and looked up
+ * like any other wave.  Adding halves both so the result stays in range
+ */
+void XFMWaveTables::blend(int w1, int w2, int mode, int ratio, float *table, int16_t *tableQ15)
+{
+    const float *a=wave(w1);
+    const float *b=wave(w2);
+    bool ring=(mode & 2) != 0;
+
+    if (ratio < 1) ratio=1;
+
+    for (int i=0; i<=Size; i++) {
+        float x=a[i];
+        float y=b[(i*ratio)%Size];
+
+        table[i]=ring ? x*y : (x+y)*0.5f;
+    }
+
+    for (int i=0; i<FixedSize; i++) {
+        float v=table[i*Size/FixedSize]*32767;
+        tableQ15[i]=static_cast<int16_t>(v < 0 ? v-0.5f : v+0.5f);
+    }
+}
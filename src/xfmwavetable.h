@@ -0,0 +1,69 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMWAVETABLE_H
+#define XFMWAVETABLE_H
+
+#include <stdint.h>
+
+/*
+ * The operator waveforms OP_WAVE1 and OP_WAVE2 select, as lookup tables.
+ *
+ *  0 sine              4 double speed sine, first half only
+ *  1 half sine         5 double speed rectified sine, first half only
+ *  2 rectified sine    6 square
+ *  3 quarter sine      7 saw
+ *
+ * The tables are worked out by the compiler and live in read-only memory,
+ * aligned to cache lines.  The float tables have a guard point at the end
+ * so a lookup can interpolate without wrapping.  The fixed point tables are
+ * 1.15, at the resolution the fixed point engine uses for its phase.
+ */
+struct XFMWaveTables {
+    enum { Waves=8, Bits=11, Size=1 << Bits, FixedBits=12, FixedSize=1 << FixedBits };
+
+    static const float *wave(int w);
+    static const int16_t *waveQ15(int w);
+
+    // Value of a float table at phase x, in cycles.  The phase is wrapped
+    // the same way xfmSine() does it
+    static inline float lookup(const float *table, float x)
+    {
+        float u=x-static_cast<float>(static_cast<int>(x));
+        u+=(u < 0) ? 1.0f : 0.0f;
+
+        float p=u*Size;
+        int i=static_cast<int>(p);
+        float f=p-static_cast<float>(i);
+
+        i&=Size-1;
+        return table[i]+(table[i+1]-table[i])*f;
+    }
+
+    // One cycle of wave w1 mixed with wave w2 at ratio times the frequency,
+    // added (mode bit 1 clear) or ring modulated (mode bit 1 set)
+    static void blend(int w1, int w2, int mode, int ratio, float *table, int16_t *tableQ15);
+};
+
+#endif // XFMWAVETABLE_H
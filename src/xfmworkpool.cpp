@@ -0,0 +1,234 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xfmworkpool.h"
+
+// The pool and worker slot the current thread belongs to, if any
+static thread_local XFMWorkPool *t_pool=nullptr;
+static thread_local int t_worker=-1;
+
+XFMWorkPool::XFMWorkPool(int threads/*=0*/)
+{
+    if (threads <= 0) {
+        threads=static_cast<int>(std::thread::hardware_concurrency())-1;
+        if (threads < 0) {
+            threads=0;
+        }
+    }
+
+    m_queued=0;
+    m_lent=false;
+    m_next=0;
+    m_steals=0;
+    m_stop=false;
+
+    for (int i=0; i<=threads; i++) {
+        m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    for (int i=0; i<threads; i++) {
+        m_threads.push_back(std::thread(&XFMWorkPool::run, this, i));
+    }
+}
+
+// parallelFor() doesn't return until its jobs are done, so there's nothing
+// left to wait for
+XFMWorkPool::~XFMWorkPool()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_stop=true;
+    }
+    m_wake.notify_all();
+
+    for (size_t i=0; i<m_threads.size(); i++) {
+        m_threads[i].join();
+    }
+}
+
+int XFMWorkPool::workers() const
+{
+    return static_cast<int>(m_queues.size());
+}
+
+long long XFMWorkPool::steals() const
+{
+    return m_steals;
+}
+
+XFMWorkPool &XFMWorkPool::shared()
+{
+    static XFMWorkPool pool;
+    return pool;
+}
+
+// Jobs queued by one of our own threads stay on its queue, where it'll find
+// them first.  Anything else is dealt out to the pool's threads in turn
+void XFMWorkPool::submit(const Job &job, Batch *batch)
+{
+    int q;
+
+    if (t_pool == this) {
+        q=t_worker;
+    } else if (m_threads.empty()) {
+        q=0;
+    } else {
+        q=static_cast<int>(m_next++%m_threads.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_queues[q]->lock);
+        m_queues[q]->tasks.push_back(Task{job, batch});
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_queued++;
+    }
+    m_wake.notify_one();
+    m_idle.notify_all();
+}
+
+// Newest first from our own queue, then oldest first from everyone else's
+bool XFMWorkPool::take(int worker, Task &task)
+{
+    int n=workers();
+
+    for (int i=0; i<n; i++) {
+        int q=(worker+i)%n;
+        Queue &queue=*m_queues[q];
+        std::lock_guard<std::mutex> locker(queue.lock);
+
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        if (i == 0) {
+            task=std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task=std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            m_steals++;
+        }
+
+        m_queued--;
+        return true;
+    }
+
+    return false;
+}
+
+bool XFMWorkPool::runOne(int worker)
+{
+    Task task;
+
+    if (!take(worker, task)) {
+        return false;
+    }
+
+    task.job(worker);
+
+    if (--task.batch->pending == 0) {
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_idle.notify_all();
+    }
+
+    return true;
+}
+
+void XFMWorkPool::run(int worker)
+{
+    t_pool=this;
+    t_worker=worker;
+
+    for (;;) {
+        if (runOne(worker)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> locker(m_lock);
+        m_wake.wait(locker, [this]() { return m_stop || m_queued > 0; });
+
+        if (m_stop) {
+            return;
+        }
+    }
+}
+
+/*
+ * Run jobs, from any batch, until this one has finished.  One of our own
+ * threads keeps its slot.  A thread from outside borrows the last slot if
+ * nobody else has it, and otherwise sleeps until it's handed back or the
+ * batch is done.  While it has the slot it counts as one of ours, so the
+ * jobs it runs can start batches of their own
+ */
+void XFMWorkPool::wait(Batch &batch)
+{
+    int worker=(t_pool == this) ? t_worker : -1;
+    bool borrowed=false;
+
+    while (batch.pending > 0) {
+        if (worker >= 0 && runOne(worker)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> locker(m_lock);
+
+        if (worker < 0 && !m_lent) {
+            m_lent=true;
+            borrowed=true;
+            worker=workers()-1;
+            t_pool=this;
+            t_worker=worker;
+            continue;
+        }
+
+        // Everything left is running on other threads
+        m_idle.wait(locker, [&]() {
+            return batch.pending == 0 || (worker >= 0 ? m_queued > 0 : !m_lent);
+        });
+    }
+
+    if (borrowed) {
+        t_pool=nullptr;
+        t_worker=-1;
+
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_lent=false;
+        m_idle.notify_all();
+    }
+}
+
+void XFMWorkPool::parallelFor(int count, const std::function<void(int index, int worker)> &fn)
+{
+    Batch batch;
+
+    batch.pending=count;
+    for (int i=0; i<count; i++) {
+        submit([&fn, i](int worker) { fn(i, worker); }, &batch);
+    }
+
+    wait(batch);
+}
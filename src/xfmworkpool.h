@@ -0,0 +1,115 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMWORKPOOL_H
+#define XFMWORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A pool of threads for batch rendering.
+ *
+ * Each thread keeps its own queue of jobs.  It takes work from the back of
+ * its own queue and, once that's empty, steals from the front of the
+ * others', so a thread that drew short jobs helps out with the long ones
+ * instead of sitting idle.  The thread that waits for the jobs joins in as
+ * well, so a pool on a four core Pi has three threads of its own.
+ *
+ * Every job is told which worker slot is running it (0 to workers()-1) so
+ * it can write into a buffer of its own and leave the mixing until the end.
+ * No two threads ever hold the same slot at once.  The pool's own threads
+ * each have one, and the last is lent to one outside thread at a time; any
+ * other outside thread that calls parallelFor() just sleeps until its jobs
+ * are done.
+ *
+ * Each parallelFor() waits only for its own jobs, so a job can call
+ * parallelFor() itself.  It carries on running jobs in its own slot until
+ * the inner ones have finished.
+ */
+class XFMWorkPool {
+public:
+    typedef std::function<void(int worker)> Job;
+
+    // threads is the number of threads to start.  0 means one less than
+    // the number of cores
+    explicit XFMWorkPool(int threads=0);
+    ~XFMWorkPool();
+
+    XFMWorkPool(const XFMWorkPool &)=delete;
+    XFMWorkPool &operator=(const XFMWorkPool &)=delete;
+
+    // Worker slots, including the one lent to a thread from outside
+    int workers() const;
+
+    // Run fn(index, worker) for each index from 0 to count-1 and wait for them all
+    void parallelFor(int count, const std::function<void(int index, int worker)> &fn);
+
+    // Jobs that were run by a thread other than the one they were queued on
+    long long steals() const;
+
+    // A pool with a thread for every core, started the first time it's needed
+    static XFMWorkPool &shared();
+
+private:
+    // The jobs from one parallelFor() that haven't finished yet
+    struct Batch {
+        std::atomic<int>    pending;
+    };
+
+    struct Task {
+        Job                 job;
+        Batch               *batch;
+    };
+
+    struct Queue {
+        std::mutex          lock;
+        std::deque<Task>    tasks;
+    };
+
+    void submit(const Job &job, Batch *batch);
+    void wait(Batch &batch);
+    void run(int worker);
+    bool runOne(int worker);
+    bool take(int worker, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;   // One per worker slot
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_lock;             // Guards sleeping and waking
+    std::condition_variable     m_wake;             // Jobs have been queued
+    std::condition_variable     m_idle;             // A batch has finished, a job has been queued or the outside slot is free
+    std::atomic<int>            m_queued;           // Jobs waiting in a queue
+    bool                        m_lent;             // The last slot is in use by a thread from outside
+    std::atomic<unsigned int>   m_next;             // Queue for the next job from outside the pool
+    std::atomic<long long>      m_steals;
+    bool                        m_stop;
+};
+
+#endif // XFMWORKPOOL_H
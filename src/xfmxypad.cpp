@@ -0,0 +1,328 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QTouchEvent>
+#include "xfmxypad.h"
+#include "SynthModel.h"
+
+XFMXYPad::XFMXYPad(QQuickItem *parent) : QQuickPaintedItem(parent)
+{
+    m_model=nullptr;
+    m_xParameter=-1;
+    m_yParameter=-1;
+    m_xMinimum=0;
+    m_xMaximum=255;
+    m_yMinimum=0;
+    m_yMaximum=255;
+    m_xValue=0;
+    m_yValue=0;
+    m_pressed=false;
+    m_color=QColor("black");
+
+    setAntialiasing(true);
+    setAcceptedMouseButtons(Qt::LeftButton);
+    setAcceptTouchEvents(true);
+}
+
+// The pad is drawn with y going up, so the top right corner is both maximums
+void XFMXYPad::paint(QPainter *painter)
+{
+    QRectF area(1, 1, width()-2, height()-2);
+    double xspan=m_xMaximum > m_xMinimum ? m_xMaximum-m_xMinimum : 1;
+    double yspan=m_yMaximum > m_yMinimum ? m_yMaximum-m_yMinimum : 1;
+    QPointF handle(area.left()+area.width()*(m_xValue-m_xMinimum)/xspan,
+                   area.bottom()-area.height()*(m_yValue-m_yMinimum)/yspan);
+    double radius=qMin(area.width(), area.height())/20;
+
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    painter->setPen(QPen(m_color, 2));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRoundedRect(area, radius, radius);
+
+    painter->setPen(QPen(m_color, 1, Qt::DotLine));
+    painter->drawLine(QPointF(handle.x(), area.top()), QPointF(handle.x(), area.bottom()));
+    painter->drawLine(QPointF(area.left(), handle.y()), QPointF(area.right(), handle.y()));
+
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(m_color);
+    painter->drawEllipse(handle, m_pressed ? radius*1.5 : radius, m_pressed ? radius*1.5 : radius);
+}
+
+QObject *XFMXYPad::model() const
+{
+    return m_model;
+}
+
+void XFMXYPad::setModel(QObject *model)
+{
+    SynthModel *m=qobject_cast<SynthModel *>(model);
+
+    if (m == m_model) {
+        return;
+    }
+
+    if (m_model != nullptr) {
+        disconnect(m_model, nullptr, this, nullptr);
+    }
+
+    m_model=m;
+
+    // Anything that reloads the pages moves the handle too
+    if (m_model != nullptr) {
+        connect(m_model, &SynthModel::patchNumberChanged, this, &XFMXYPad::reload);
+        connect(m_model, &SynthModel::unitChanged, this, &XFMXYPad::reload);
+        connect(m_model, &SynthModel::deviceChanged, this, &XFMXYPad::reload);
+    }
+
+    emit modelChanged();
+    reload();
+}
+
+int XFMXYPad::xParameter() const
+{
+    return m_xParameter;
+}
+
+void XFMXYPad::setXParameter(int offset)
+{
+    if (offset != m_xParameter) {
+        m_xParameter=offset;
+        emit xParameterChanged();
+        reload();
+    }
+}
+
+int XFMXYPad::yParameter() const
+{
+    return m_yParameter;
+}
+
+void XFMXYPad::setYParameter(int offset)
+{
+    if (offset != m_yParameter) {
+        m_yParameter=offset;
+        emit yParameterChanged();
+        reload();
+    }
+}
+
+int XFMXYPad::xMinimum() const
+{
+    return m_xMinimum;
+}
+
+void XFMXYPad::setXMinimum(int v)
+{
+    m_xMinimum=v;
+    emit rangeChanged();
+    update();
+}
+
+int XFMXYPad::xMaximum() const
+{
+    return m_xMaximum;
+}
+
+void XFMXYPad::setXMaximum(int v)
+{
+    m_xMaximum=v;
+    emit rangeChanged();
+    update();
+}
+
+int XFMXYPad::yMinimum() const
+{
+    return m_yMinimum;
+}
+
+void XFMXYPad::setYMinimum(int v)
+{
+    m_yMinimum=v;
+    emit rangeChanged();
+    update();
+}
+
+int XFMXYPad::yMaximum() const
+{
+    return m_yMaximum;
+}
+
+void XFMXYPad::setYMaximum(int v)
+{
+    m_yMaximum=v;
+    emit rangeChanged();
+    update();
+}
+
+int XFMXYPad::xValue() const
+{
+    return m_xValue;
+}
+
+int XFMXYPad::yValue() const
+{
+    return m_yValue;
+}
+
+bool XFMXYPad::pressed() const
+{
+    return m_pressed;
+}
+
+QColor XFMXYPad::color() const
+{
+    return m_color;
+}
+
+void XFMXYPad::setColor(const QColor &c)
+{
+    m_color=c;
+    emit colorChanged();
+    update();
+}
+
+void XFMXYPad::mousePressEvent(QMouseEvent *event)
+{
+    press(event->localPos());
+    event->accept();
+}
+
+void XFMXYPad::mouseMoveEvent(QMouseEvent *event)
+{
+    moveTo(event->localPos());
+    event->accept();
+}
+
+void XFMXYPad::mouseReleaseEvent(QMouseEvent *event)
+{
+    release();
+    event->accept();
+}
+
+// Only the first finger counts
+void XFMXYPad::touchEvent(QTouchEvent *event)
+{
+    if (event->touchPoints().isEmpty()) {
+        event->ignore();
+        return;
+    }
+
+    QPointF pos=event->touchPoints().first().pos();
+
+    switch (event->type()) {
+        case QEvent::TouchBegin:
+            press(pos);
+            break;
+
+        case QEvent::TouchUpdate:
+            moveTo(pos);
+            break;
+
+        default:
+            release();
+            break;
+    }
+
+    event->accept();
+}
+
+// Pick up the values from the edit buffer, unless a finger is on the pad
+void XFMXYPad::reload()
+{
+    if (m_model == nullptr || m_pressed) {
+        return;
+    }
+
+    m_xValue=m_xParameter >= 0 ? m_model->parameterValue(m_xParameter) : m_xMinimum;
+    m_yValue=m_yParameter >= 0 ? m_model->parameterValue(m_yParameter) : m_yMinimum;
+
+    emit valueChanged();
+    update();
+}
+
+void XFMXYPad::press(const QPointF &pos)
+{
+    // Keep hold of the gesture so the page doesn't swipe away under it
+    setKeepMouseGrab(true);
+    setKeepTouchGrab(true);
+
+    m_pressed=true;
+    emit pressedChanged();
+
+    moveTo(pos);
+}
+
+void XFMXYPad::moveTo(const QPointF &pos)
+{
+    if (!m_pressed || width() <= 2 || height() <= 2) {
+        return;
+    }
+
+    double fx=(pos.x()-1)/(width()-2);
+    double fy=1-(pos.y()-1)/(height()-2);
+
+    if (fx < 0) fx=0;
+    if (fx > 1) fx=1;
+    if (fy < 0) fy=0;
+    if (fy > 1) fy=1;
+
+    int x=m_xMinimum+static_cast<int>(fx*(m_xMaximum-m_xMinimum)+0.5);
+    int y=m_yMinimum+static_cast<int>(fy*(m_yMaximum-m_yMinimum)+0.5);
+
+    if (x == m_xValue && y == m_yValue) {
+        return;
+    }
+
+    m_xValue=x;
+    m_yValue=y;
+
+    if (m_model != nullptr) {
+        m_model->writeParameterPair(m_xParameter, m_xValue, m_yParameter, m_yValue);
+    }
+
+    emit valueChanged();
+    update();
+}
+
+// The pages only catch up once the finger comes off, rather than on every move
+void XFMXYPad::release()
+{
+    if (!m_pressed) {
+        return;
+    }
+
+    setKeepMouseGrab(false);
+    setKeepTouchGrab(false);
+
+    m_pressed=false;
+    emit pressedChanged();
+    update();
+
+    if (m_model != nullptr) {
+        m_model->refreshPages();
+    }
+}
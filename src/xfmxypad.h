@@ -0,0 +1,124 @@
+/*
+ * XFM2 Synth Controller
+ *
+ * This is a user-friendly controller for the excellent XFM2 synth hardware designed by Futur3soundz
+ * https://www.futur3soundz.com/xfm2
+ *
+ *
+ * This file is part of the XFM2Controller distribution (https://github.com/ataristdude/xfm2controller).
+ * Copyright (c) 2020 Don Fletcher
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XFMXYPAD_H
+#define XFMXYPAD_H
+
+#include <QColor>
+#include <QPointF>
+#include <QQuickPaintedItem>
+
+class QPainter;
+class SynthModel;
+
+/*
+ * A two dimensional control that drives a pair of parameters on the
+ * active unit, e.g. an operator's ratio against its level, or FX wet
+ * against feedback.
+ *
+ * Each move of a finger (or the mouse) sends both parameters together in
+ * one write to the synth.  The pad follows the edit buffer, so undo or
+ * loading a patch puts the handle back where the parameters are.
+ */
+class XFMXYPad : public QQuickPaintedItem {
+    Q_OBJECT
+
+    Q_PROPERTY(QObject *model READ model WRITE setModel NOTIFY modelChanged)
+    Q_PROPERTY(int xParameter READ xParameter WRITE setXParameter NOTIFY xParameterChanged)
+    Q_PROPERTY(int yParameter READ yParameter WRITE setYParameter NOTIFY yParameterChanged)
+    Q_PROPERTY(int xMinimum READ xMinimum WRITE setXMinimum NOTIFY rangeChanged)
+    Q_PROPERTY(int xMaximum READ xMaximum WRITE setXMaximum NOTIFY rangeChanged)
+    Q_PROPERTY(int yMinimum READ yMinimum WRITE setYMinimum NOTIFY rangeChanged)
+    Q_PROPERTY(int yMaximum READ yMaximum WRITE setYMaximum NOTIFY rangeChanged)
+    Q_PROPERTY(int xValue READ xValue NOTIFY valueChanged)
+    Q_PROPERTY(int yValue READ yValue NOTIFY valueChanged)
+    Q_PROPERTY(bool pressed READ pressed NOTIFY pressedChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+
+public:
+    explicit XFMXYPad(QQuickItem *parent = nullptr);
+
+    void paint(QPainter *painter) override;
+
+    QObject *model() const;
+    void setModel(QObject *model);
+
+    int xParameter() const;
+    void setXParameter(int offset);
+    int yParameter() const;
+    void setYParameter(int offset);
+
+    int xMinimum() const;
+    void setXMinimum(int v);
+    int xMaximum() const;
+    void setXMaximum(int v);
+    int yMinimum() const;
+    void setYMinimum(int v);
+    int yMaximum() const;
+    void setYMaximum(int v);
+
+    int xValue() const;
+    int yValue() const;
+    bool pressed() const;
+
+    QColor color() const;
+    void setColor(const QColor &c);
+
+signals:
+    void modelChanged();
+    void xParameterChanged();
+    void yParameterChanged();
+    void rangeChanged();
+    void valueChanged();
+    void pressedChanged();
+    void colorChanged();
+
+protected:
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void touchEvent(QTouchEvent *event) override;
+
+private slots:
+    void reload();
+
+private:
+    void press(const QPointF &pos);
+    void moveTo(const QPointF &pos);
+    void release();
+
+    SynthModel *    m_model;
+    int             m_xParameter;       // Parameter offsets, or -1 if unbound
+    int             m_yParameter;
+    int             m_xMinimum;
+    int             m_xMaximum;
+    int             m_yMinimum;
+    int             m_yMaximum;
+    int             m_xValue;
+    int             m_yValue;
+    bool            m_pressed;
+    QColor          m_color;
+};
+
+#endif // XFMXYPAD_H